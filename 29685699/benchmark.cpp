@@ -0,0 +1,379 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cmdline.h"
+#include "wordreader.h"
+
+#define WARMUP_RUNS 1
+#define REPEAT_RUNS 5
+#define INPUT_DIR "bench_inputs"
+/* the most threads `--threads` accepts */
+#define MAX_BENCH_THREADS 1024
+
+/* One program to benchmark: how to run it and how it uses threads. */
+struct Variant {
+    std::string name;
+    std::string binary;
+    std::vector<std::string> args;
+    /* "serial", "openmp" (thread count set with OMP_NUM_THREADS) or "pthread" (thread count passed as the last argument) */
+    std::string model;
+    /* the thread count of a serial variant */
+    int fixedThreads;
+};
+
+/* Wall-clock times of the measured runs of one variant at one thread count and input size. */
+struct Measurement {
+    std::string variant;
+    std::string model;
+    int threads = 1;
+    double size = 1.0;
+    size_t inputBytes = 0;
+    std::vector<double> runs;
+    bool failed = false;
+};
+
+/* Settings taken from the command line. */
+struct Options {
+    std::vector<int> threads;
+    std::vector<double> sizes = {0.25, 0.5, 1.0};
+    std::vector<std::string> only;
+    int warmup = WARMUP_RUNS;
+    int repeats = REPEAT_RUNS;
+    std::string output = "bench.json";
+};
+
+/**
+ * The function SplitList splits a comma separated command line value.
+ */
+std::vector<std::string> SplitList(const std::string& value) {
+    std::vector<std::string> items;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+/**
+ * The function PrepareInputs writes the first `size` of every book, cut at a whitespace boundary, into
+ * its own directory under `INPUT_DIR`, so that every program can be run at that input size unchanged.
+ *
+ * @param filenames The books, read from the current directory.
+ * @param size The fraction of each book to keep, in (0, 1].
+ * @param inputBytes Receives the total size of the cut books.
+ *
+ * @return the directory holding the cut books. The program exits if a book cannot be read or written.
+ */
+std::string PrepareInputs(const std::vector<std::string>& filenames, double size, size_t& inputBytes) {
+    std::string dir = std::string(INPUT_DIR) + "/size_" + std::to_string(static_cast<int>(std::lround(size * 100)));
+    mkdir(INPUT_DIR, 0755);
+    mkdir(dir.c_str(), 0755);
+    inputBytes = 0;
+
+    for (const auto& filename : filenames) {
+        MappedFile file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file" << std::endl;
+            exit(1);
+        }
+
+        size_t length = static_cast<size_t>(file.size() * size);
+        while (length < file.size() && !IsSpace(file.data()[length])) {
+            length++;
+        }
+        std::string path = dir + "/" + filename;
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(file.data(), length);
+        out.close();
+        if (!out.good()) {
+            std::cerr << "Failed to write " << path << std::endl;
+            exit(1);
+        }
+        inputBytes += length;
+    }
+    return dir;
+}
+
+/**
+ * The function RunOnce starts a program in `dir` with its output discarded and waits for it.
+ *
+ * @param variant The program to run.
+ * @param threads The value of OMP_NUM_THREADS for the run, also appended to the arguments of a
+ * "pthread" variant.
+ * @param dir The working directory, holding the input books.
+ * @param milliseconds Receives the wall-clock time from start to exit.
+ *
+ * @return true if the program exited with status 0.
+ */
+bool RunOnce(const Variant& variant, int threads, const std::string& dir, double& milliseconds) {
+    char binary[PATH_MAX];
+    if (realpath(variant.binary.c_str(), binary) == nullptr) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char*> argv;
+        argv.push_back(binary);
+        for (const auto& arg : variant.args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        std::string threadArg = std::to_string(threads);
+        if (variant.model == "pthread") {
+            argv.push_back(const_cast<char*>(threadArg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        setenv("OMP_NUM_THREADS", std::to_string(threads).c_str(), 1);
+        if (chdir(dir.c_str()) != 0) {
+            _exit(127);
+        }
+        execv(binary, argv.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+        return false;
+    }
+    auto end = std::chrono::steady_clock::now();
+    milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * The function Median returns the median of a list of times.
+ */
+double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/**
+ * The function ConfidenceInterval gives the 95% confidence interval of the mean of a list of times,
+ * using Student's t distribution since there are only a few runs.
+ *
+ * @param values The measured times, at least two.
+ * @param mean Receives the mean.
+ *
+ * @return the half width of the interval around the mean.
+ */
+double ConfidenceInterval(const std::vector<double>& values, double& mean) {
+    /* two-sided 95% critical values of t for 1..30 degrees of freedom */
+    static const double t95[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    size_t n = values.size();
+    mean = 0;
+    for (double v : values) {
+        mean += v;
+    }
+    mean /= n;
+    if (n < 2) {
+        return 0;
+    }
+
+    double variance = 0;
+    for (double v : values) {
+        variance += (v - mean) * (v - mean);
+    }
+    variance /= n - 1;
+    double t = n - 1 <= 30 ? t95[n - 2] : 1.960;
+    return t * std::sqrt(variance / n);
+}
+
+/**
+ * The function WriteJson writes every measurement with its median, mean and 95% confidence interval.
+ *
+ * @param path The file to write.
+ * @param results The measurements.
+ * @param options The settings the measurements were taken with.
+ */
+void WriteJson(const std::string& path, const std::vector<Measurement>& results, const Options& options) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        exit(1);
+    }
+
+    out << "{\n";
+    out << "  \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n";
+    out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+    out << "  \"warmup\": " << options.warmup << ",\n";
+    out << "  \"repeats\": " << options.repeats << ",\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Measurement& m = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"variant\": \"" << m.variant << "\", \"model\": \"" << m.model
+            << "\", \"threads\": " << m.threads << ", \"size\": " << m.size << ", \"input_bytes\": " << m.inputBytes;
+        if (m.failed) {
+            out << ", \"status\": \"failed\"}";
+            continue;
+        }
+
+        double mean = 0;
+        double halfWidth = ConfidenceInterval(m.runs, mean);
+        out << ", \"status\": \"ok\", \"runs_ms\": [";
+        for (size_t r = 0; r < m.runs.size(); ++r) {
+            out << (r ? ", " : "") << m.runs[r];
+        }
+        out << "], \"median_ms\": " << Median(m.runs) << ", \"mean_ms\": " << mean
+            << ", \"ci95_ms\": [" << mean - halfWidth << ", " << mean + halfWidth << "]}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+/**
+ * The main function builds the list of variants (the serial Bloom filter; the OpenMP Bloom filter
+ * per file, chunked and work-stealing, the last two with shared and with private merged filters; and
+ * the sequential and pthread word counters from `video_code`), runs each one at every input size and
+ * thread count with warm-up runs followed by measured repeats, prints a summary line per measurement
+ * and writes all of them as JSON. The OpenMP and pthread variants follow the thread counts; the serial
+ * ones run once per size.
+ *
+ * Options: `--threads=1,2,4` (1 to `MAX_BENCH_THREADS`, default: powers of two up to the number of
+ * CPUs), `--sizes=0.25,0.5,1` (fractions of each book, 0.01 to 1), `--only=name,...`, `--warmup=N`,
+ * `--repeats=N` (at least 1), `--output=PATH` (default `bench.json`). Run it from the directory with
+ * the books and the built programs.
+ *
+ * @return 0 if every run succeeded, 1 otherwise.
+ */
+int main(int argc, char* argv[]) {
+    const std::vector<std::string> filenames = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
+    const std::vector<Variant> variants = {
+        {"bloom_serial", "./bloomfilters", {}, "serial", 1},
+        {"bloom_openmp", "./bfparallel", {}, "openmp", 0},
+        {"bloom_openmp_chunked", "./bfparallel", {"--chunked"}, "openmp", 0},
+        {"bloom_openmp_chunked_private", "./bfparallel", {"--chunked", "--merge=private"}, "openmp", 0},
+        {"bloom_openmp_stealing", "./bfparallel", {"--stealing"}, "openmp", 0},
+        {"bloom_openmp_stealing_private", "./bfparallel", {"--stealing", "--merge=private"}, "openmp", 0},
+        {"count_sequential", "./count_sequential", {}, "serial", 1},
+        {"count_pthread", "./count_pthread", {}, "pthread", 0},
+    };
+    Options options;
+    int status = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--threads=", 0) == 0) {
+            for (const auto& item : SplitList(arg.substr(10))) {
+                unsigned long long threads = 0;
+                if (!ParseUnsigned(item, 1, MAX_BENCH_THREADS, threads)) {
+                    std::cerr << "Invalid value: " << arg << " (--threads takes counts of 1 to " << MAX_BENCH_THREADS << ")" << std::endl;
+                    return 1;
+                }
+                options.threads.push_back(static_cast<int>(threads));
+            }
+        } else if (arg.rfind("--sizes=", 0) == 0) {
+            options.sizes.clear();
+            for (const auto& item : SplitList(arg.substr(8))) {
+                double size = 0;
+                if (!ParseReal(item, size) || size < 0.01 || size > 1) {
+                    std::cerr << "Invalid value: " << arg << " (--sizes takes fractions of 0.01 to 1)" << std::endl;
+                    return 1;
+                }
+                options.sizes.push_back(size);
+            }
+            if (options.sizes.empty()) {
+                std::cerr << "Invalid value: " << arg << " (--sizes takes fractions of 0.01 to 1)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--only=", 0) == 0) {
+            options.only = SplitList(arg.substr(7));
+        } else if (arg.rfind("--warmup=", 0) == 0) {
+            unsigned long long warmup = 0;
+            if (!ParseUnsigned(arg.substr(9), 0, INT_MAX, warmup)) {
+                std::cerr << "Invalid value: " << arg << " (--warmup takes 0 to " << INT_MAX << ")" << std::endl;
+                return 1;
+            }
+            options.warmup = static_cast<int>(warmup);
+        } else if (arg.rfind("--repeats=", 0) == 0) {
+            unsigned long long repeats = 0;
+            if (!ParseUnsigned(arg.substr(10), 1, INT_MAX, repeats)) {
+                std::cerr << "Invalid value: " << arg << " (--repeats takes 1 to " << INT_MAX << ")" << std::endl;
+                return 1;
+            }
+            options.repeats = static_cast<int>(repeats);
+        } else if (arg.rfind("--output=", 0) == 0) {
+            options.output = arg.substr(9);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.threads.empty()) {
+        int cpus = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+        for (int t = 1; t < cpus; t *= 2) {
+            options.threads.push_back(t);
+        }
+        options.threads.push_back(cpus);
+    }
+
+    std::vector<Measurement> results;
+    for (double size : options.sizes) {
+        size_t inputBytes = 0;
+        std::string dir = PrepareInputs(filenames, size, inputBytes);
+
+        for (const auto& variant : variants) {
+            if (!options.only.empty() && std::find(options.only.begin(), options.only.end(), variant.name) == options.only.end()) {
+                continue;
+            }
+            std::vector<int> threadCounts = variant.model == "serial" ? std::vector<int>{variant.fixedThreads} : options.threads;
+
+            for (int threads : threadCounts) {
+                Measurement m;
+                m.variant = variant.name;
+                m.model = variant.model;
+                m.threads = threads;
+                m.size = size;
+                m.inputBytes = inputBytes;
+
+                for (int r = 0; r < options.warmup + options.repeats && !m.failed; ++r) {
+                    double milliseconds = 0;
+                    if (!RunOnce(variant, threads, dir, milliseconds)) {
+                        m.failed = true;
+                    } else if (r >= options.warmup) {
+                        m.runs.push_back(milliseconds);
+                    }
+                }
+
+                if (m.failed) {
+                    std::cerr << variant.name << " failed at size " << size << " with " << threads << " threads" << std::endl;
+                    status = 1;
+                } else {
+                    double mean = 0;
+                    double halfWidth = ConfidenceInterval(m.runs, mean);
+                    std::cout << variant.name << ", " << threads << " threads, size " << size << ": median "
+                              << Median(m.runs) << " ms, mean " << mean << " +/- " << halfWidth << " ms (95%).\n" << std::flush;
+                }
+                results.push_back(m);
+            }
+        }
+    }
+
+    WriteJson(options.output, results, options);
+    std::cout << "Results written to " << options.output << std::endl;
+    return status;
+}
@@ -1,133 +1,495 @@
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <string>
-#include <bitset>
 #include <chrono>
-#include <cctype>
+#include <memory>
+#include <vector>
 #include <omp.h>
 
-#define BLOOM_FILTER_SIZE 1000000
+#include "bloomfilter.h"
+#include "chunkedreader.h"
+#include "cmdline.h"
+#include "filterfile.h"
+#include "hyperloglog.h"
+
 #define FILE_COUNT 3
+#define STREAM_REPORT_SECONDS 1
 
-std::bitset<BLOOM_FILTER_SIZE> bloom_filter;  // Single Bloom filter for all files
 omp_lock_t lock;
 
-/**
- * The function `hash1` calculates a hash value for a given string using the djb2 algorithm.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. 
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash1(const std::string& str) {
-    unsigned int hash = 5381;
-    for (char c : str) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
+/* Settings taken from the command line. */
+struct Options {
+    bool chunked = false;
+    bool stealing = false;
+    std::string merge = "shared";
+    std::string filter = "classic";
+    FilterParams params;
+    std::string save;
+    std::string stream;
+    size_t streamBuffer = STREAM_BUFFER_SIZE;
+};
 
 /**
- * The function `hash2` calculates a hash value for a given string using a bitwise operation and
- * returns the hash modulo a constant value `BLOOM_FILTER_SIZE`.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. 
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash2(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 6) + (hash << 16) - hash;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-
-/**
- * The hash3 function takes a string as input and returns an unsigned integer hash value.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. 
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash3(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 7) + (hash << 15) - hash;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-/**
- * The function reads words from a file, converts them to lowercase, checks if they are already in a
- * Bloom filter, and inserts them if they are not.
+ * The function maps a file into memory, walks its words in place, checks if they are already in a
+ * Bloom filter, and inserts them if they are not. Case is folded by the hash functions, so no word is
+ * copied.
  * 
  * @param filename The filename parameter is a string that represents the name of the file from which
  * we want to read words.
- * @param filter The `filter` parameter is a reference to a `std::bitset` object with a size of
- * `BLOOM_FILTER_SIZE`. The `std::bitset` is used as a Bloom filter to check for the presence of words
- * in a file.
+ * @param filter The `filter` parameter is a reference to a `BloomFilter` or `BlockedBloomFilter`
+ * object with a size of `BLOOM_FILTER_SIZE` bits, used to check for the presence of words in a file.
+ * @param sketch The HyperLogLog sketch of the file, updated from the same hash as the filter.
  * 
  * @return the number of unique words that were read from the file and inserted into the bloom filter.
  */
 
-int ReadAndInsert(const std::string& filename, std::bitset<BLOOM_FILTER_SIZE>& filter) {
+template <typename Filter>
+int ReadAndInsert(const std::string& filename, Filter& filter, HyperLogLog& sketch) {
     int uniqueWordsCount = 0;
-    std::ifstream file(filename);
-    std::string word;
+    MappedFile file(filename);
 
     if (!file.is_open()) {
         std::cerr << "Failed to open file" << std::endl;
         exit(1);
     }
 
-    while (file >> word) {
-        for (char& c : word) {
-            c = std::tolower(c);
+    ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        uint64_t hash = HashWord(word);
+        sketch.addHash(hash);
+        if (!filter.insertHash(hash)) {
+            return;
         }
 
-        if (filter[hash1(word)] &&
-            filter[hash2(word)] &&
-            filter[hash3(word)]) {
-            continue;
+        uniqueWordsCount++;
+    });
+
+    return uniqueWordsCount;
+}
+/**
+ * The function maps one file into memory, splits it into whitespace-aligned byte ranges and has every
+ * thread tokenize and insert its own range, so ingestion of a single file scales with the number of
+ * cores instead of the number of files.
+ *
+ * @param filename The name of the file from which we want to read words.
+ * @param target A callable taking the thread number and returning the filter that thread inserts
+ * into: the same shared filter for every thread, or a private filter per thread.
+ * @param sketch The HyperLogLog sketch of the file, shared by all threads.
+ * @param stats Receives the words, bytes and time of each thread.
+ *
+ * @return the number of words that the filters reported as new.
+ */
+template <typename Target>
+int ReadAndInsertChunked(const std::string& filename, Target&& target, HyperLogLog& sketch, std::vector<ThreadStats>& stats) {
+    MappedFile file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+
+    std::vector<int> uniqueWordsCount(omp_get_max_threads(), 0);
+
+    stats = ParallelForEachWord(file.view(), [&](int thread, std::string_view word) {
+        uint64_t hash = HashWord(word);
+        sketch.addHash(hash);
+        if (target(thread).insertHash(hash)) {
+            uniqueWordsCount[thread]++;
         }
+    });
 
-        filter[hash1(word)] = 1;
-        filter[hash2(word)] = 1;
-        filter[hash3(word)] = 1;
+    int total = 0;
+    for (int count : uniqueWordsCount) {
+        total += count;
+    }
+    return total;
+}
+/**
+ * The function maps every file into memory and inserts all of them at once with the work-stealing
+ * scheduler: the files are cut into `STEAL_CHUNK_SIZE` chunks, and threads that run out of chunks of
+ * their own take chunks of the files still being read, so a large file no longer keeps one thread busy
+ * long after the others have finished.
+ *
+ * @param filenames The files to read, `FILE_COUNT` of them.
+ * @param target A callable taking the thread and file numbers and returning the filter that thread
+ * inserts the words of that file into, shared or private as for `ReadAndInsertChunked`.
+ * @param sketches One HyperLogLog sketch per file, shared by all threads.
+ * @param uniqueWordsCount Receives the number of words the filters of each file reported as new.
+ * @param stats Receives the words, bytes, chunks and time of each thread.
+ */
+template <typename Target>
+void ReadAndInsertStealing(const std::string filenames[], Target&& target, std::vector<HyperLogLog>& sketches, int uniqueWordsCount[], std::vector<ThreadStats>& stats) {
+    std::vector<std::unique_ptr<MappedFile>> files;
+    std::vector<std::string_view> views;
 
-        uniqueWordsCount++;
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        files.push_back(std::make_unique<MappedFile>(filenames[i]));
+        if (!files.back()->is_open()) {
+            std::cerr << "Failed to open file" << std::endl;
+            exit(1);
+        }
+        views.push_back(files.back()->view());
     }
 
-    return uniqueWordsCount;
+    /* one row of per-file counters per thread, so no counter is shared */
+    std::vector<std::vector<int>> counts(omp_get_max_threads(), std::vector<int>(FILE_COUNT, 0));
+
+    stats = StealingForEachWord(views, STEAL_CHUNK_SIZE, [&](int thread, int file, std::string_view word) {
+        uint64_t hash = HashWord(word);
+        sketches[file].addHash(hash);
+        if (target(thread, file).insertHash(hash)) {
+            counts[thread][file]++;
+        }
+    });
+
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        uniqueWordsCount[i] = 0;
+        for (const auto& row : counts) {
+            uniqueWordsCount[i] += row[i];
+        }
+    }
 }
-int main() {
-    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
-    std::bitset<BLOOM_FILTER_SIZE> bloom_filters[FILE_COUNT];
+/**
+ * The function ReportSketches prints the HyperLogLog estimate of the distinct words of every file and
+ * of all files together, next to the Bloom filter counts, which miss every word that was a false
+ * positive when it was first inserted.
+ *
+ * @param filenames The names of the files.
+ * @param sketches One sketch per file.
+ * @param count The number of files.
+ */
+void ReportSketches(const std::string filenames[], const std::vector<HyperLogLog>& sketches, int count) {
+    HyperLogLog all(sketches[0].precision());
+    std::cout << "Estimated distinct words (HyperLogLog, " << sketches[0].bytes() / 1024.0 << " KB per file):";
+    for (int i = 0; i < count; ++i) {
+        all.merge(sketches[i]);
+        std::cout << (i ? ", " : " ") << filenames[i] << " " << std::lround(sketches[i].estimate());
+    }
+    if (count > 1) {
+        std::cout << ", all files together " << std::lround(all.estimate());
+    }
+    std::cout << ".\n";
+}
+/**
+ * The function RunWithFilter builds one filter of the given type per file, either one thread per file,
+ * one file at a time split across all threads when `options.chunked` is set, or all files at once with
+ * the work-stealing scheduler when `options.stealing` is set, and prints the timings with the load
+ * imbalance between the threads. The filters are saved when `options.save` is set.
+ *
+ * In the two modes where several threads read the same file, `options.merge` picks how they share its
+ * filter. "shared" has all of them insert into it directly with atomic `fetch_or`, so they contend on
+ * the same cache lines. "private" gives every thread but the first a private copy of each filter to
+ * insert into without contention, and ORs the copies into the real filters with `TreeMerge` once all
+ * words are read. A word seen by several threads is then new in several copies, so the unique word
+ * counts are estimated from the merged filters instead.
+ *
+ * Every word also goes into a HyperLogLog sketch of its file, and the estimates are printed with the
+ * filter counts.
+ *
+ * @param filenames The files to read, `FILE_COUNT` of them.
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void RunWithFilter(const std::string filenames[], const Options& options) {
+    std::vector<Filter> bloom_filters;
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        bloom_filters.emplace_back(options.params);
+    }
+    std::cout << "Filter size: " << bloom_filters[0].bits() << " bits (" << bloom_filters[0].bytes() / 1024.0 << " KB), " << bloom_filters[0].hashes() << " hashes per word.\n";
+    std::vector<HyperLogLog> sketches(FILE_COUNT);
     int uniqueWordsCount[FILE_COUNT] = {0};
+    int totalUniqueWords = 0;
 
-    int totalUniqueWords = 0;  // Declare the variable here
+    /* copies of the filters for threads 1 and up with --merge=private; thread 0 uses the real ones */
+    std::vector<std::vector<Filter>> privateFilters(options.merge == "private" ? omp_get_max_threads() - 1 : 0);
+    for (auto& row : privateFilters) {
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            row.emplace_back(options.params);
+        }
+    }
+    auto target = [&](int thread, int file) -> Filter& {
+        return thread == 0 || privateFilters.empty() ? bloom_filters[file] : privateFilters[thread - 1][file];
+    };
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
-    #pragma omp parallel for reduction(+:totalUniqueWords)
-    for (int i = 0; i < FILE_COUNT; ++i) {
-        auto readStart = std::chrono::high_resolution_clock::now();
-        uniqueWordsCount[i] = ReadAndInsert(filenames[i], bloom_filters[i]);
-        totalUniqueWords += uniqueWordsCount[i];  // This is where the reduction will take place
-        auto readEnd = std::chrono::high_resolution_clock::now();
-
-        auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
-        #pragma omp critical
-        {
+    if (options.stealing) {
+        std::vector<ThreadStats> stats;
+        ReadAndInsertStealing(filenames, target, sketches, uniqueWordsCount, stats);
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            totalUniqueWords += uniqueWordsCount[i];
+        }
+        PrintThreadStats(stats);
+        PrintLoadImbalance(stats);
+    } else if (options.chunked) {
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            std::vector<ThreadStats> stats;
+            auto readStart = std::chrono::high_resolution_clock::now();
+            uniqueWordsCount[i] = ReadAndInsertChunked(filenames[i], [&](int thread) -> Filter& { return target(thread, i); }, sketches[i], stats);
+            totalUniqueWords += uniqueWordsCount[i];
+            auto readEnd = std::chrono::high_resolution_clock::now();
+
+            auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
             std::cout << "Time taken to read " << filenames[i] << ": " << readDuration << " microseconds, or approximately " << readDuration / 1000.0 << " milliseconds.\n";
+            PrintThreadStats(stats);
+            PrintLoadImbalance(stats);
+        }
+    } else {
+        #pragma omp parallel for reduction(+:totalUniqueWords)
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            auto readStart = std::chrono::high_resolution_clock::now();
+            uniqueWordsCount[i] = ReadAndInsert(filenames[i], bloom_filters[i], sketches[i]);
+            totalUniqueWords += uniqueWordsCount[i];  // This is where the reduction will take place
+            auto readEnd = std::chrono::high_resolution_clock::now();
+
+            auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
+            #pragma omp critical
+            {
+                std::cout << "Time taken to read " << filenames[i] << ": " << readDuration << " microseconds, or approximately " << readDuration / 1000.0 << " milliseconds.\n";
+            }
         }
     }
 
+    if (!privateFilters.empty()) {
+        auto mergeStart = std::chrono::high_resolution_clock::now();
+        totalUniqueWords = 0;
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            std::vector<Filter*> copies = {&bloom_filters[i]};
+            for (auto& row : privateFilters) {
+                copies.push_back(&row[i]);
+            }
+            TreeMerge(copies);
+            uniqueWordsCount[i] = static_cast<int>(std::lround(bloom_filters[i].estimateCount()));
+            totalUniqueWords += uniqueWordsCount[i];
+        }
+        auto mergeEnd = std::chrono::high_resolution_clock::now();
+
+        auto mergeDuration = std::chrono::duration_cast<std::chrono::microseconds>(mergeEnd - mergeStart).count();
+        std::cout << "Time taken to merge " << privateFilters.size() + 1 << " copies of each filter: " << mergeDuration << " microseconds, or approximately " << mergeDuration / 1000.0 << " milliseconds.\n";
+        std::cout << "Unique words are estimated from the set bits of the merged filters.\n";
+    }
+
     auto t2 = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
 
     std::cout << "Total time taken: " << duration << " microseconds, or approximately " << duration / 1000.0 << " milliseconds.\n";
     std::cout << "Total unique words from read files: " << totalUniqueWords << std::endl;
+    ReportSketches(filenames, sketches, FILE_COUNT);
 
+    if (!options.save.empty()) {
+        auto saveStart = std::chrono::high_resolution_clock::now();
+        if (!SaveFilters(options.save, bloom_filters.data(), filenames, uniqueWordsCount, static_cast<const WordSet*>(nullptr), FILE_COUNT)) {
+            exit(1);
+        }
+        auto saveEnd = std::chrono::high_resolution_clock::now();
+        auto saveDuration = std::chrono::duration_cast<std::chrono::microseconds>(saveEnd - saveStart).count();
+        std::cout << "Time taken to save " << options.save << ": " << saveDuration << " microseconds, or approximately " << saveDuration / 1000.0 << " milliseconds.\n";
+    }
+}
+/**
+ * The function StreamAndInsert inserts the words of stdin (`-`) or a FIFO into one filter as they
+ * arrive, reading through a buffer of `options.streamBuffer` bytes, and prints the bytes, words and
+ * throughput so far every `STREAM_REPORT_SECONDS` seconds.
+ *
+ * @param filter The filter to insert into.
+ * @param sketch The HyperLogLog sketch of the stream.
+ * @param options The settings from the command line; `options.stream` names the input.
+ *
+ * @return the number of unique words that were inserted into the filter.
+ */
+template <typename Filter>
+long long StreamAndInsert(Filter& filter, HyperLogLog& sketch, const Options& options) {
+    long long uniqueWordsCount = 0;
+    int fd = options.stream == "-" ? STDIN_FILENO : open(options.stream.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto lastReport = start;
+    long long wordCount = ForEachStreamWord(fd, options.streamBuffer, [&](std::string_view word) {
+        uint64_t hash = HashWord(word);
+        sketch.addHash(hash);
+        if (filter.insertHash(hash)) {
+            uniqueWordsCount++;
+        }
+    }, [&](unsigned long long bytesRead, long long words) {
+        auto now = std::chrono::high_resolution_clock::now();
+        if (now - lastReport < std::chrono::seconds(STREAM_REPORT_SECONDS)) {
+            return;
+        }
+        lastReport = now;
+        double seconds = std::chrono::duration<double>(now - start).count();
+        std::cout << "  Streamed " << bytesRead / 1e6 << " MB, " << words << " words, " << uniqueWordsCount << " unique (" << bytesRead / 1e6 / seconds << " MB/s).\n" << std::flush;
+    });
+
+    if (wordCount < 0) {
+        std::cerr << "Failed to read " << options.stream << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return uniqueWordsCount;
+}
+/**
+ * The function RunStream builds one filter from `options.stream` instead of the books, prints the
+ * timings and saves the filter when `options.save` is set.
+ *
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void RunStream(const Options& options) {
+    Filter filter(options.params);
+    std::vector<HyperLogLog> sketches(1);
+    std::cout << "Filter size: " << filter.bits() << " bits (" << filter.bytes() / 1024.0 << " KB), " << filter.hashes() << " hashes per word.\n";
+
+    auto readStart = std::chrono::high_resolution_clock::now();
+    long long uniqueWordsCount = StreamAndInsert(filter, sketches[0], options);
+    auto readEnd = std::chrono::high_resolution_clock::now();
+
+    auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
+    std::cout << "Time taken to read " << options.stream << ": " << readDuration << " microseconds, or approximately " << readDuration / 1000.0 << " milliseconds.\n";
+    std::cout << "Total unique words from read files: " << uniqueWordsCount << std::endl;
+    ReportSketches(&options.stream, sketches, 1);
+
+    if (!options.save.empty()) {
+        if (!SaveFilters(options.save, &filter, &options.stream, &uniqueWordsCount, static_cast<const WordSet*>(nullptr), 1)) {
+            exit(1);
+        }
+    }
+}
+/**
+ * The main function reads multiple files and inserts their words into one bloom filter per file. By
+ * default each file is handled by one thread; with `--chunked` the files are read one after the other
+ * and every thread works on a byte range of the current file, with per-thread throughput printed.
+ * `--stealing` reads all files at once as `STEAL_CHUNK_SIZE` chunks on per-thread deques, with idle
+ * threads stealing chunks from busy ones, for inputs of very different sizes. Both print the load
+ * imbalance, the busiest thread's time above the mean. With either of them, `--merge=private`
+ * has the threads fill private copies of the filters that are ORed together afterwards instead of
+ * sharing one (`--merge=shared`, the default).
+ * `--filter=blocked` selects the cache-line blocked filter instead of the classic one. Each filter has
+ * `BLOOM_FILTER_SIZE` bits and `HASH_COUNT` probes unless `--bits=`/`--hashes=` are given, or
+ * `--expected-words=` (distinct words per file) with an optional `--fp-rate=` (default 0.01) to size
+ * it from the vocabulary. `--expected-words=auto` takes the vocabulary from a HyperLogLog pass over
+ * the files instead. `--save=PATH` writes the filters to a filter file. This program keeps no
+ * exact words, so the file holds the filters only; `bfparallelQuery --load` answers from them without
+ * verification, and `bfparallelQuery --save` writes both.
+ * `--stream=PATH` reads one stream instead of the books, from stdin when PATH is `-` or from a FIFO,
+ * through a buffer of `--stream-buffer=BYTES` (`STREAM_MIN_BUFFER_SIZE` to `STREAM_MAX_BUFFER_SIZE`,
+ * default `STREAM_BUFFER_SIZE`). A stream is read by one thread, so `--chunked`, `--stealing` and
+ * `--merge=private` are refused with it.
+ *
+ * @return The main function is returning an integer value of 0.
+ */
+int main(int argc, char* argv[]) {
+    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
+    Options options;
+    double expectedWords = 0;
+    double fpRate = 0.01;
+    bool autoSize = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--chunked") {
+            options.chunked = true;
+        } else if (arg == "--stealing") {
+            options.stealing = true;
+        } else if (arg.rfind("--merge=", 0) == 0) {
+            options.merge = arg.substr(8);
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            options.filter = arg.substr(9);
+        } else if (arg.rfind("--bits=", 0) == 0) {
+            unsigned long long bits = 0;
+            if (!ParseUnsigned(arg.substr(7), 1, UINT32_MAX, bits)) {
+                std::cerr << "Invalid value: " << arg << " (--bits takes 1 to 4294967295)" << std::endl;
+                return 1;
+            }
+            options.params.bits = static_cast<uint32_t>(bits);
+        } else if (arg.rfind("--hashes=", 0) == 0) {
+            unsigned long long hashes = 0;
+            if (!ParseUnsigned(arg.substr(9), 1, MAX_HASH_COUNT, hashes)) {
+                std::cerr << "Invalid value: " << arg << " (--hashes takes 1 to " << MAX_HASH_COUNT << ")" << std::endl;
+                return 1;
+            }
+            options.params.hashes = static_cast<int>(hashes);
+        } else if (arg == "--expected-words=auto") {
+            autoSize = true;
+        } else if (arg.rfind("--expected-words=", 0) == 0) {
+            if (!ParseReal(arg.substr(17), expectedWords) || expectedWords < 1) {
+                std::cerr << "Invalid value: " << arg << " (--expected-words takes a count of at least 1, or auto)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--fp-rate=", 0) == 0) {
+            if (!ParseReal(arg.substr(10), fpRate) || fpRate <= 0 || fpRate >= 1) {
+                std::cerr << "Invalid value: " << arg << " (--fp-rate takes a rate between 0 and 1, exclusive)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--save=", 0) == 0) {
+            options.save = arg.substr(7);
+        } else if (arg.rfind("--stream=", 0) == 0) {
+            options.stream = arg.substr(9);
+        } else if (arg.rfind("--stream-buffer=", 0) == 0) {
+            unsigned long long bytes = 0;
+            if (!ParseUnsigned(arg.substr(16), STREAM_MIN_BUFFER_SIZE, STREAM_MAX_BUFFER_SIZE, bytes)) {
+                std::cerr << "Invalid value: " << arg << " (--stream-buffer takes " << STREAM_MIN_BUFFER_SIZE << " to " << STREAM_MAX_BUFFER_SIZE << " bytes)" << std::endl;
+                return 1;
+            }
+            options.streamBuffer = bytes;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.merge != "shared" && options.merge != "private") {
+        std::cerr << "Unknown merge strategy: " << options.merge << std::endl;
+        return 1;
+    }
+    if (options.merge == "private" && !options.chunked && !options.stealing) {
+        std::cerr << "--merge=private needs --chunked or --stealing" << std::endl;
+        return 1;
+    }
+
+    if (!options.stream.empty() && (options.chunked || options.stealing || options.merge == "private")) {
+        std::cerr << "--stream is read by one thread; it cannot be combined with --chunked, --stealing or --merge=private" << std::endl;
+        return 1;
+    }
+    if (autoSize && !options.stream.empty()) {
+        std::cerr << "--expected-words=auto cannot read a stream twice; give a number instead" << std::endl;
+        return 1;
+    }
+
+    /* sizing from the expected vocabulary overrides --bits and --hashes */
+    if (autoSize) {
+        expectedWords = LargestVocabulary(filenames, FILE_COUNT);
+    }
+    if (expectedWords > 0) {
+        options.params = OptimalParams(expectedWords, fpRate);
+    }
+
+    if (!options.stream.empty()) {
+        if (options.filter == "classic") {
+            RunStream<BloomFilter>(options);
+        } else if (options.filter == "blocked") {
+            RunStream<BlockedBloomFilter>(options);
+        } else {
+            std::cerr << "Unknown filter: " << options.filter << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (options.filter == "classic") {
+        RunWithFilter<BloomFilter>(filenames, options);
+    } else if (options.filter == "blocked") {
+        RunWithFilter<BlockedBloomFilter>(filenames, options);
+    } else {
+        std::cerr << "Unknown filter: " << options.filter << std::endl;
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,134 +1,527 @@
 #include <iostream>
-#include <fstream>
+#include <algorithm>
 #include <string>
-#include <bitset>
 #include <chrono>
-#include <cctype>
-#include <unordered_set>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <omp.h>
 
-#define BLOOM_FILTER_SIZE 1000000
+#include "bitslicedindex.h"
+#include "bloomfilter.h"
+#include "chunkedreader.h"
+#include "cmdline.h"
+#include "countminsketch.h"
+#include "cuckoofilter.h"
+#include "filterfile.h"
+#include "fusefilter.h"
+#include "hyperloglog.h"
+#include "perfcounters.h"
+#include "pipelinedreader.h"
+#include "wordset.h"
+
 #define FILE_COUNT 3
+#define QUERY_BATCH_SIZE 32
+#define MAX_QUERY_BATCH 65536
+#define SKETCH_MERGE_SLICE (1 << 14)
 
-std::bitset<BLOOM_FILTER_SIZE> bloom_filter;  // Single Bloom filter for all files
 omp_lock_t lock;
-std::unordered_set<std::string> exact_sets[FILE_COUNT];  // Array to store exact words for each file
+WordSet exact_sets[FILE_COUNT];  // Array to store exact words for each file
+std::unique_ptr<PhaseProfiler> profiler;  // Set by --profile until the first query run is reported
+std::vector<CountMinSketch> frequency_sketches;  // One per thread with --count-min, added into the first after reading
+
+/*
+ * Filters that can remove words, and so can replace a document in place. Every ingest path inserts
+ * each distinct word into them once, as told by the exact set, so that removing a document's words
+ * undoes exactly its inserts; their exact sets therefore hold every distinct word.
+ */
+template <typename Filter>
+struct CanRemove {
+    static const bool value = false;
+};
+
+template <>
+struct CanRemove<CountingBloomFilter> {
+    static const bool value = true;
+};
+
+template <>
+struct CanRemove<CuckooFilter> {
+    static const bool value = true;
+};
+
+/* Settings taken from the command line. */
+struct Options {
+    bool chunked = false;
+    std::string filter = "classic";
+    FilterParams params;
+    int queryBatch = QUERY_BATCH_SIZE;
+    std::string save;
+    std::string load;
+    int replaceIndex = -1;
+    std::string replaceWith;
+    int freeze = 0;
+    bool profile = false;
+    std::string profileOutput;
+    bool countMin = false;
+    uint32_t countMinWidth = CMS_WIDTH;
+    int countMinDepth = CMS_DEPTH;
+    bool conservative = false;
+    bool pipelined = false;
+    size_t pipelineBuffer = PIPELINE_BUFFER_SIZE;
+    int pipelineDepth = PIPELINE_DEPTH;
+    bool uring = true;
+};
 
 /**
- * The function `hash1` calculates a hash value for a given string using the djb2 algorithm.
+ * The function maps a file into memory, walks its words in place, checks if they are already in a
+ * Bloom filter, and inserts them into a word set if they are not. Only words that are new to the
+ * filter are copied (in lowercase) into the set, and each word is hashed once for both. A filter that
+ * can remove words (`CanRemove`) is the other way round: the exact set is checked first and each
+ * distinct word is inserted into the filter once.
  * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. It represents the
- * string for which we want to calculate the hash value.
+ * @param filename The filename parameter is a string that represents the name of the file from which
+ * we want to read words.
+ * @param filter The parameter `filter` is a reference to a `BloomFilter` or `BlockedBloomFilter`
+ * object with a size of `BLOOM_FILTER_SIZE` bits. It is used to check for the presence of words in the
+ * set.
+ * @param exact_set The `exact_set` parameter is a `WordSet` which is used to store the unique words
+ * read from the file.
  * 
- * @return an unsigned integer, which is the hash value of the input string.
+ * @return the count of unique words that were inserted into the `exact_set`.
  */
-unsigned int hash1(const std::string& str) {
-    unsigned int hash = 5381;
-    for (char c : str) {
-        hash = ((hash << 5) + hash) + c;
+
+template <typename Filter>
+int ReadAndInsert(const std::string& filename, Filter& filter, WordSet& exact_set) {
+    int uniqueWordsCount = 0;
+    MappedFile file(filename);
+    CountMinSketch* sketch = frequency_sketches.empty() ? nullptr : &frequency_sketches[omp_get_thread_num()];
+
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
     }
-    return hash % BLOOM_FILTER_SIZE;
-}
 
+    ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        uint64_t hash = HashWord(word);
+        if (sketch) {
+            sketch->addHash(hash);
+        }
+        /* a filter that can remove words takes each distinct word once, as told by the exact set */
+        if constexpr (CanRemove<Filter>::value) {
+            if (exact_set.insertHash(hash, word)) {
+                filter.insertHash(hash);
+                uniqueWordsCount++;
+            }
+        } else if (filter.insertHash(hash)) {
+            uniqueWordsCount++;
+            exact_set.insertHash(hash, word);
+        }
+    });
+
+    return uniqueWordsCount;
+}
 /**
- * The function `hash2` calculates a hash value for a given string using a bitwise operation and
- * returns the hash modulo a constant value `BLOOM_FILTER_SIZE`.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. It represents the
- * string for which we want to calculate the hash value.
- * 
- * @return an unsigned integer, which is the hash value of the input string.
+ * The function maps one file into memory, splits it into whitespace-aligned byte ranges and has every
+ * thread tokenize and insert its own range into the same shared filter. Each thread collects its new words
+ * in a private set, and the private sets are merged into `exact_set` at the end. A filter that can
+ * remove words is only filled after the merge, with each distinct word once.
+ *
+ * @param filename The name of the file from which we want to read words.
+ * @param filter The shared filter every thread inserts into.
+ * @param exact_set Receives the unique words of the file.
+ * @param stats Receives the words, bytes and time of each thread.
+ *
+ * @return the number of words that the filter reported as new.
  */
-unsigned int hash2(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 6) + (hash << 16) - hash;
+template <typename Filter>
+int ReadAndInsertChunked(const std::string& filename, Filter& filter, WordSet& exact_set, std::vector<ThreadStats>& stats) {
+    MappedFile file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
     }
-    return hash % BLOOM_FILTER_SIZE;
-}
 
+    std::vector<WordSet> thread_sets(omp_get_max_threads());
+
+    stats = ParallelForEachWord(file.view(), [&](int thread, std::string_view word) {
+        uint64_t hash = HashWord(word);
+        if (!frequency_sketches.empty()) {
+            frequency_sketches[thread].addHash(hash);
+        }
+        if (CanRemove<Filter>::value || filter.insertHash(hash)) {
+            thread_sets[thread].insertHash(hash, word);
+        }
+    });
+
+    int uniqueWordsCount = 0;
+    for (auto& thread_set : thread_sets) {
+        uniqueWordsCount += thread_set.size();
+        exact_set.merge(thread_set);
+    }
+    /* a filter that can remove words only gets each distinct word once the thread sets are merged */
+    if constexpr (CanRemove<Filter>::value) {
+        exact_set.ForEach([&](uint64_t hash, std::string_view) {
+            filter.insertHash(hash);
+        });
+        uniqueWordsCount = exact_set.size();
+    }
+    return uniqueWordsCount;
+}
 /**
- * The hash3 function takes a string as input and returns an unsigned integer hash value.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. It represents the
- * string for which we want to calculate the hash value.
- * 
- * @return an unsigned integer, which is the hash value of the input string.
+ * The function reads all files through the read-ahead pipeline of `PipelinedForEachWord`: a reader
+ * thread keeps `options.pipelineDepth` buffers of `options.pipelineBuffer` bytes in flight while every
+ * thread tokenizes and inserts the buffers already filled, so the reads of a slow volume overlap the
+ * hashing instead of alternating with it. Every thread keeps its own set per file, and the sets are
+ * merged into the exact sets once all files are read.
+ *
+ * @param filenames The files to read, `FILE_COUNT` of them.
+ * @param bloom_filters The shared filters every thread inserts into, one per file.
+ * @param uniqueWordsCount Receives the number of words the filter of each file reported as new.
+ * @param options The settings from the command line.
+ *
+ * @return what the reader and each thread did.
  */
-unsigned int hash3(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 7) + (hash << 15) - hash;
+template <typename Filter>
+PipelineStats ReadAndInsertPipelined(const std::string filenames[], std::vector<Filter>& bloom_filters, int uniqueWordsCount[], const Options& options) {
+    std::vector<std::vector<WordSet>> thread_sets(omp_get_max_threads());
+    for (auto& sets : thread_sets) {
+        sets.resize(FILE_COUNT);
+    }
+
+    PipelineStats stats = PipelinedForEachWord(std::vector<std::string>(filenames, filenames + FILE_COUNT), options.pipelineBuffer, options.pipelineDepth, options.uring,
+                                               [&](int thread, int file, std::string_view word) {
+        uint64_t hash = HashWord(word);
+        if (!frequency_sketches.empty()) {
+            frequency_sketches[thread].addHash(hash);
+        }
+        if constexpr (CanRemove<Filter>::value) {
+            thread_sets[thread][file].insertHash(hash, word);
+        } else if (bloom_filters[file].insertHash(hash)) {
+            thread_sets[thread][file].insertHash(hash, word);
+        }
+    });
+    if (!stats.failedFile.empty()) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+    if (!stats.readError.empty()) {
+        std::cerr << "Failed to read " << stats.readError << std::endl;
+        exit(1);
     }
-    return hash % BLOOM_FILTER_SIZE;
+
+    #pragma omp parallel for
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        uniqueWordsCount[i] = 0;
+        for (auto& sets : thread_sets) {
+            uniqueWordsCount[i] += sets[i].size();
+            exact_sets[i].merge(sets[i]);
+        }
+        /* a filter that can remove words takes each distinct word once, as in the other ingest paths */
+        if constexpr (CanRemove<Filter>::value) {
+            exact_sets[i].ForEach([&](uint64_t hash, std::string_view) {
+                bloom_filters[i].insertHash(hash);
+            });
+            uniqueWordsCount[i] = exact_sets[i].size();
+        }
+    }
+    return stats;
 }
 /**
- * The function reads words from a file, converts them to lowercase, checks if they are already in a
- * Bloom filter, and inserts them into an unordered set if they are not.
- * 
- * @param filename The filename parameter is a string that represents the name of the file from which
- * we want to read words.
- * @param filter The parameter `filter` is a reference to a `std::bitset` object with a size of
- * `BLOOM_FILTER_SIZE`. This `std::bitset` is used as a Bloom filter to check for the presence of words
- * in the set.
- * @param exact_set The `exact_set` parameter is an `std::unordered_set<std::string>` which is used to
- * store the unique words read from the file.
- * 
- * @return the count of unique words that were inserted into the `exact_set`.
+ * The function ProfiledReadAndInsert does the work of `ReadAndInsert` as four separate passes, so
+ * that `profiler` can give each its own counters: read (map the file and touch every page, so the
+ * page faults land here), tokenize (collect the words), hash and insert. The words and hashes are kept
+ * in buffers between the passes, which the fused loop of `ReadAndInsert` does not need, so the passes
+ * add up to a little more than a normal run.
+ *
+ * @param filename The name of the file from which we want to read words.
+ * @param filter The filter of the file.
+ * @param exact_set Receives the unique words of the file.
+ * @param thread The index of the calling thread in `profiler`.
+ *
+ * @return the same count as `ReadAndInsert` for this filter type.
  */
+template <typename Filter>
+int ProfiledReadAndInsert(const std::string& filename, Filter& filter, WordSet& exact_set, int thread) {
+    PhaseProfiler::Mark mark = profiler->start();
+    MappedFile file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+    volatile char touched = 0;
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < file.size(); offset += pageSize) {
+        touched = touched ^ file.data()[offset];
+    }
+    profiler->record(thread, PHASE_READ, mark, file.size());
+
+    mark = profiler->start();
+    std::vector<std::string_view> words;
+    ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        words.push_back(word);
+    });
+    profiler->record(thread, PHASE_TOKENIZE, mark, words.size());
+
+    mark = profiler->start();
+    std::vector<uint64_t> hashes(words.size());
+    for (size_t w = 0; w < words.size(); ++w) {
+        hashes[w] = HashWord(words[w]);
+    }
+    profiler->record(thread, PHASE_HASH, mark, words.size());
 
-int ReadAndInsert(const std::string& filename, std::bitset<BLOOM_FILTER_SIZE>& filter, std::unordered_set<std::string>& exact_set) {
+    mark = profiler->start();
     int uniqueWordsCount = 0;
-    std::ifstream file(filename);
-    std::string word;
+    for (size_t w = 0; w < words.size(); ++w) {
+        if (!frequency_sketches.empty()) {
+            frequency_sketches[thread].addHash(hashes[w]);
+        }
+        /* a filter that can remove words takes each distinct word once, as in `ReadAndInsert` */
+        if constexpr (CanRemove<Filter>::value) {
+            if (exact_set.insertHash(hashes[w], words[w])) {
+                filter.insertHash(hashes[w]);
+                uniqueWordsCount++;
+            }
+        } else if (filter.insertHash(hashes[w])) {
+            uniqueWordsCount++;
+            exact_set.insertHash(hashes[w], words[w]);
+        }
+    }
+    profiler->record(thread, PHASE_INSERT, mark, words.size());
+
+    return uniqueWordsCount;
+}
+
+/**
+ * The function ReplaceDocument updates a counting or cuckoo filter and its exact set in place when the
+ * file they were built from is replaced by another one. Words that are only in the old file are removed,
+ * words that are only in the new file are inserted, and words in both are left alone, so the filter
+ * changes by the size of the difference rather than being rebuilt.
+ *
+ * @param filename The new contents of the file.
+ * @param filter The counting or cuckoo filter built from the old file.
+ * @param exact_set The distinct words of the old file; replaced by those of the new file.
+ * @param removed Receives the number of words removed.
+ * @param added Receives the number of words added.
+ */
+template <typename Filter>
+void ReplaceDocument(const std::string& filename, Filter& filter, WordSet& exact_set, int& removed, int& added) {
+    MappedFile file(filename);
+    WordSet updated;
 
     if (!file.is_open()) {
         std::cerr << "Failed to open file" << std::endl;
         exit(1);
     }
 
-    while (file >> word) {
-        for (char& c : word) {
-            c = std::tolower(c);
+    ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        updated.insert(word);
+    });
+
+    removed = 0;
+    added = 0;
+    exact_set.ForEach([&](uint64_t hash, std::string_view word) {
+        if (!updated.containsHash(hash, word)) {
+            filter.removeHash(hash);
+            removed++;
+        }
+    });
+    updated.ForEach([&](uint64_t hash, std::string_view word) {
+        if (!exact_set.containsHash(hash, word)) {
+            filter.insertHash(hash);
+            added++;
         }
+    });
+    exact_set = std::move(updated);
+}
+/**
+ * The function ReplaceAndReport replaces file `options.replaceIndex` with `options.replaceWith` and
+ * prints the time taken and the size of the change. The program exits if the filter type cannot
+ * remove words.
+ *
+ * @param bloom_filters An array of `FILE_COUNT` filters.
+ * @param filenames The files the filters were built from; the replaced one is set to its new name.
+ * @param uniqueWordsCount The number of unique words of each file; the replaced one is set to the
+ * distinct words of the new file.
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void ReplaceAndReport(Filter bloom_filters[], std::string filenames[], int uniqueWordsCount[], const Options& options) {
+    if constexpr (!CanRemove<Filter>::value) {
+        std::cerr << "--replace needs --filter=counting or --filter=cuckoo" << std::endl;
+        exit(1);
+    } else {
+        int removed = 0;
+        int added = 0;
+        auto updateStart = std::chrono::high_resolution_clock::now();
+        ReplaceDocument(options.replaceWith, bloom_filters[options.replaceIndex], exact_sets[options.replaceIndex], removed, added);
+        auto updateEnd = std::chrono::high_resolution_clock::now();
 
-        if (filter[hash1(word)] &&
-            filter[hash2(word)] &&
-            filter[hash3(word)]) {
-            continue;
+        auto updateDuration = std::chrono::duration_cast<std::chrono::microseconds>(updateEnd - updateStart).count();
+        std::cout << "Time taken to replace " << filenames[options.replaceIndex] << " with " << options.replaceWith << ": " << updateDuration << " microseconds, or approximately " << updateDuration / 1000.0 << " milliseconds (" << removed << " words removed, " << added << " added).\n";
+        filenames[options.replaceIndex] = options.replaceWith;
+        uniqueWordsCount[options.replaceIndex] = exact_sets[options.replaceIndex].size();
+    }
+}
+/**
+ * The function ResolveQueryBatch checks a batch of query words against every bloom filter and exact
+ * set. All words are hashed and every probe of every filter is prefetched first, and only then are
+ * the filters read, so the memory latency of the whole batch overlaps instead of being paid one word
+ * at a time. The same hash is reused for the exact set lookup.
+ *
+ * @param batch The query words, as they appear in the query file.
+ * @param hashes Scratch space for one hash per word.
+ * @param count The number of words in the batch.
+ * @param bloom_filters An array of `fileCount` bloom filters.
+ * @param exact_sets An array of `fileCount` exact sets, used to tell false positives from real hits.
+ * @param fileCount The number of files, bloom filters and exact sets.
+ *
+ * @return the number of false positives in the batch.
+ */
+template <typename Filter>
+int ResolveQueryBatch(const std::string_view batch[], uint64_t hashes[], int count, const Filter bloom_filters[], const WordSet exact_sets[], int fileCount) {
+    int count_false_positive = 0;
+
+    for (int j = 0; j < count; ++j) {
+        hashes[j] = HashWord(batch[j]);
+        for (int i = 0; i < fileCount; ++i) {
+            bloom_filters[i].prefetch(hashes[j]);
         }
+    }
+
+    for (int j = 0; j < count; ++j) {
+        bool existsInAny = false;
+        bool isFalsePositive = true;
 
-        filter[hash1(word)] = 1;
-        filter[hash2(word)] = 1;
-        filter[hash3(word)] = 1;
+    /* checking if a query word exists in any of the Bloom filters and exact sets. */
+        for (int i = 0; i < fileCount; ++i) {
+            if (bloom_filters[i].containsHash(hashes[j])) {
+
+                existsInAny = true;
+
+                if (exact_sets[i].containsHash(hashes[j], batch[j])) {
+                    isFalsePositive = false;
+                    break;
+                }
+            }
+        }
 
-        uniqueWordsCount++;
-        exact_set.insert(word);
+        if (existsInAny && isFalsePositive) {
+            count_false_positive++;
+        }
     }
+    return count_false_positive;
+}
+/**
+ * This overload of ResolveQueryBatch answers a batch from a `BitSlicedIndex`: one AND of `hashes`
+ * rows gives every file whose filter contains the word, and only those files' exact sets are checked.
+ */
+int ResolveQueryBatch(const std::string_view batch[], uint64_t hashes[], int count, const BitSlicedIndex::Slice slices[], const WordSet exact_sets[], int fileCount) {
+    const BitSlicedIndex& index = slices[0].index();
+    std::vector<uint64_t> candidates(index.maskWords());
+    int count_false_positive = 0;
 
-    return uniqueWordsCount;
+    for (int j = 0; j < count; ++j) {
+        hashes[j] = HashWord(batch[j]);
+        index.prefetch(hashes[j]);
+    }
+
+    for (int j = 0; j < count; ++j) {
+        if (!index.candidatesHash(hashes[j], candidates.data())) {
+            continue;
+        }
+
+        bool isFalsePositive = true;
+        for (int w = 0; w < index.maskWords() && isFalsePositive; ++w) {
+            for (uint64_t bits = candidates[w]; bits != 0; bits &= bits - 1) {
+                int i = w * 64 + __builtin_ctzll(bits);
+                if (exact_sets[i].containsHash(hashes[j], batch[j])) {
+                    isFalsePositive = false;
+                    break;
+                }
+            }
+        }
+
+        if (isFalsePositive) {
+            count_false_positive++;
+        }
+    }
+    return count_false_positive;
 }
 /**
  * The function QueryBloomFilters takes in a query file, an array of bloom filters, an array of exact
  * sets, and the number of files, and checks for false positives in the bloom filters for each query
- * word.
+ * word. The query file is split on line boundaries into one range per thread; every thread resolves
+ * its range in batches of `batchSize` with `ResolveQueryBatch` and keeps its own false positive count,
+ * and the counts are summed at the end. The filters and exact sets are only read, so they are shared.
  * 
  * @param query_filename The query_filename parameter is a string that represents the name of the file
  * containing the queries.
- * @param bloom_filters An array of bloom filters. Each bloom filter is represented by a
- * std::bitset<BLOOM_FILTER_SIZE> object.
- * @param exact_sets The parameter `exact_sets` is an array of `std::unordered_set<std::string>`. It is
- * used to store the exact sets of words for each file. Each element in the array corresponds to a
- * file, and the `std::unordered_set<std::string>` stores the unique words present
+ * @param bloom_filters An array of bloom filters, either `BloomFilter` or `BlockedBloomFilter`
+ * objects.
+ * @param exact_sets The parameter `exact_sets` is an array of `WordSet`. It is used to store the exact
+ * sets of words for each file. Each element in the array corresponds to a file, and the `WordSet`
+ * stores the unique words present
  * @param fileCount The parameter `fileCount` represents the number of files or bloom filters in the
  * `bloom_filters` array and the `exact_sets` array. It indicates the size of these arrays and
  * determines the number of iterations in the for loop that checks each bloom filter and exact set.
+ * @param batchSize The number of query words hashed and prefetched together; 1 disables batching.
+ * @param stats Receives the queries, bytes and time of each thread.
+ *
+ * @return the number of false positives.
  */
 
-void QueryBloomFilters(const std::string& query_filename, std::bitset<BLOOM_FILTER_SIZE> bloom_filters[], std::unordered_set<std::string> exact_sets[], int fileCount) {
-    std::ifstream query_file(query_filename);
-    std::string query_word;
-    int dummy;
+template <typename Filter>
+int QueryBloomFilters(const std::string& query_filename, Filter bloom_filters[], const WordSet exact_sets[], int fileCount, int batchSize, std::vector<ThreadStats>& stats) {
+    MappedFile query_file(query_filename);
+    int count_false_positive = 0;
+
+    if (!query_file.is_open()) {
+        std::cerr << "Failed to open query file" << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::pair<size_t, size_t>> chunks = SplitIntoLineChunks(query_file.view(), omp_get_max_threads());
+    stats.assign(chunks.size(), ThreadStats());
+
+    #pragma omp parallel for schedule(static, 1) reduction(+:count_false_positive)
+    for (int t = 0; t < static_cast<int>(chunks.size()); ++t) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::string_view> batch(batchSize);
+        std::vector<uint64_t> hashes(batchSize);
+        int count = 0;
+        const char* begin = query_file.data() + chunks[t].first;
+        const char* end = query_file.data() + chunks[t].second;
+
+        stats[t].words = ForEachQueryWord(begin, end, [&](std::string_view query_word) {
+            batch[count++] = query_word;
+            if (count == batchSize) {
+                count_false_positive += ResolveQueryBatch(batch.data(), hashes.data(), count, bloom_filters, exact_sets, fileCount);
+                count = 0;
+            }
+        });
+        count_false_positive += ResolveQueryBatch(batch.data(), hashes.data(), count, bloom_filters, exact_sets, fileCount);
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        stats[t].bytes = chunks[t].second - chunks[t].first;
+        stats[t].microseconds = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+    }
+
+    return count_false_positive;
+}
+/**
+ * The function ProfiledQueryBloomFilters answers the queries like `QueryBloomFilters`, split into two
+ * passes per thread so that `profiler` can tell them apart: query (parse, hash and probe every filter,
+ * keeping a bit mask of the files whose filter said yes) and verify (check the exact sets of those
+ * files to find the false positives). It does not batch or prefetch.
+ *
+ * @return the number of false positives.
+ */
+template <typename Filter>
+int ProfiledQueryBloomFilters(const std::string& query_filename, Filter bloom_filters[], const WordSet exact_sets[], int fileCount, std::vector<ThreadStats>& stats) {
+    MappedFile query_file(query_filename);
     int count_false_positive = 0;
 
     if (!query_file.is_open()) {
@@ -136,72 +529,700 @@ void QueryBloomFilters(const std::string& query_filename, std::bitset<BLOOM_FILT
         exit(1);
     }
 
-    while (query_file >> query_word >> dummy) {
-        for (char& c : query_word) {
-            c = std::tolower(c);
+    std::vector<std::pair<size_t, size_t>> chunks = SplitIntoLineChunks(query_file.view(), omp_get_max_threads());
+    stats.assign(chunks.size(), ThreadStats());
+
+    #pragma omp parallel for schedule(static, 1) reduction(+:count_false_positive)
+    for (int t = 0; t < static_cast<int>(chunks.size()); ++t) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::string_view> words;
+        std::vector<uint64_t> hashes;
+        std::vector<uint64_t> candidates;
+        const char* begin = query_file.data() + chunks[t].first;
+        const char* end = query_file.data() + chunks[t].second;
+
+        PhaseProfiler::Mark mark = profiler->start();
+        stats[t].words = ForEachQueryWord(begin, end, [&](std::string_view query_word) {
+            uint64_t hash = HashWord(query_word);
+            uint64_t mask = 0;
+            for (int i = 0; i < fileCount; ++i) {
+                mask |= uint64_t(bloom_filters[i].containsHash(hash)) << i;
+            }
+            if (mask != 0) {
+                words.push_back(query_word);
+                hashes.push_back(hash);
+                candidates.push_back(mask);
+            }
+        });
+        profiler->record(t, PHASE_QUERY, mark, stats[t].words);
+
+        mark = profiler->start();
+        for (size_t j = 0; j < words.size(); ++j) {
+            bool isFalsePositive = true;
+            for (uint64_t bits = candidates[j]; bits != 0 && isFalsePositive; bits &= bits - 1) {
+                isFalsePositive = !exact_sets[__builtin_ctzll(bits)].containsHash(hashes[j], words[j]);
+            }
+            count_false_positive += isFalsePositive;
         }
+        profiler->record(t, PHASE_VERIFY, mark, words.size());
 
-        bool existsInAny = false;
-        bool isFalsePositive = true;
+        auto stop = std::chrono::high_resolution_clock::now();
+        stats[t].bytes = chunks[t].second - chunks[t].first;
+        stats[t].microseconds = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+    }
 
-    /* checking if a query word exists in any of the Bloom filters and exact sets. */
-        for (int i = 0; i < fileCount; ++i) {
-            if (bloom_filters[i][hash1(query_word)] &&
-                bloom_filters[i][hash2(query_word)] &&
-                bloom_filters[i][hash3(query_word)]) {
+    return count_false_positive;
+}
+/**
+ * The function RunQueries runs `query.txt` against the filters and exact sets and prints the query
+ * time, the per-thread breakdown and the number of false positives.
+ *
+ * @param bloom_filters An array of `fileCount` bloom filters.
+ * @param options The settings from the command line.
+ * @param fileCount The number of filters.
+ * @param verified false when the exact sets are empty because only filters were loaded; every query
+ * a filter accepts is then counted and reported as a positive answer rather than a false positive.
+ */
+template <typename Filter>
+void RunQueries(Filter bloom_filters[], const Options& options, int fileCount = FILE_COUNT, bool verified = true) {
+    std::vector<ThreadStats> queryStats;
+    auto queryStart = std::chrono::high_resolution_clock::now();
+    int count_false_positive = profiler ? ProfiledQueryBloomFilters("query.txt", bloom_filters, exact_sets, fileCount, queryStats)
+                                        : QueryBloomFilters("query.txt", bloom_filters, exact_sets, fileCount, options.queryBatch, queryStats);
+    auto queryEnd = std::chrono::high_resolution_clock::now();
 
-                existsInAny = true;
+    auto queryDuration = std::chrono::duration_cast<std::chrono::microseconds>(queryEnd - queryStart).count();
+    long long queryCount = 0;
+    for (const auto& stat : queryStats) {
+        queryCount += stat.words;
+    }
+    std::cout << "Time taken to query: " << queryDuration << " microseconds, or approximately " << queryDuration / 1000.0 << " milliseconds (" << (queryDuration > 0 ? queryCount * 1e6 / queryDuration : 0.0) << " queries per second).\n";
+    PrintThreadStats(queryStats);
+    if (verified) {
+        std::cout << "Number of false positives: " << count_false_positive << std::endl;
+    } else {
+        std::cout << "Number of positive answers: " << count_false_positive << " (the filter file holds no exact words, so they are not verified)" << std::endl;
+    }
 
-                if (exact_sets[i].find(query_word) != exact_sets[i].end()) {
-                    isFalsePositive = false;
-                    break;
-                }
+    if (profiler) {
+        profiler->printReport();
+        if (!options.profileOutput.empty()) {
+            profiler->writeJson(options.profileOutput);
+        }
+        /* one report per run: later query runs, such as --freeze, are not profiled */
+        profiler.reset();
+    }
+}
+/**
+ * The function RunFrozenQueries builds one binary fuse filter with `Fingerprint`-sized entries from
+ * the distinct words of every file, one thread per file, prints the construction time and the size
+ * next to that of the filters they replace, and runs the queries against them.
+ *
+ * @param vocabularies The distinct words of every file, `FILE_COUNT` sets.
+ * @param filterBytes The total size of the filters built from the books.
+ * @param options The settings from the command line.
+ */
+template <typename Fingerprint>
+void RunFrozenQueries(const WordSet vocabularies[], size_t filterBytes, const Options& options) {
+    std::vector<BinaryFuseFilter<Fingerprint>> frozen(FILE_COUNT);
+    auto freezeStart = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel for
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        std::vector<uint64_t> hashes;
+        hashes.reserve(vocabularies[i].size());
+        vocabularies[i].ForEach([&](uint64_t hash, std::string_view) {
+            hashes.push_back(hash);
+        });
+        frozen[i] = BinaryFuseFilter<Fingerprint>(std::move(hashes));
+    }
+    auto freezeEnd = std::chrono::high_resolution_clock::now();
+
+    size_t frozenBytes = 0;
+    size_t words = 0;
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        if (!frozen[i].built()) {
+            std::cerr << "Failed to freeze the filter of file " << i << std::endl;
+            exit(1);
+        }
+        frozenBytes += frozen[i].bytes();
+        words += vocabularies[i].size();
+    }
+
+    auto freezeDuration = std::chrono::duration_cast<std::chrono::microseconds>(freezeEnd - freezeStart).count();
+    std::cout << "Frozen filters hold " << words << " distinct words.\n";
+    std::cout << "Time taken to freeze the filters: " << freezeDuration << " microseconds, or approximately " << freezeDuration / 1000.0 << " milliseconds.\n";
+    std::cout << "Frozen " << sizeof(Fingerprint) * 8 << "-bit binary fuse filters: " << frozenBytes / 1024.0 << " KB (" << frozenBytes * 8.0 / words
+              << " bits per word), against " << filterBytes / 1024.0 << " KB (" << filterBytes * 8.0 / words << " bits per word) before.\n";
+    RunQueries(frozen.data(), options);
+}
+/**
+ * The function FreezeAndQuery replaces the filters with static binary fuse filters of
+ * `options.freeze` bits per entry for the query-only phase and runs the queries again, so the two can
+ * be compared. A fuse filter must hold every distinct word of its file, or it answers no for words
+ * that are there. Only the exact sets of the filters that can remove words have them all; the other
+ * filters keep just the words they reported as new, which leaves out every word whose first insert
+ * was a false positive. For those, each file (or its replacement from `--replace`) is read again into
+ * a word set of its own.
+ *
+ * @param bloom_filters An array of `FILE_COUNT` filters, used only for their size.
+ * @param filenames The files the filters were built from; not read for counting and cuckoo filters.
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void FreezeAndQuery(const Filter bloom_filters[], const std::string filenames[], const Options& options) {
+    size_t filterBytes = 0;
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        filterBytes += bloom_filters[i].bytes();
+    }
+
+    const WordSet* vocabularies = exact_sets;
+    std::vector<WordSet> read_sets;
+    if constexpr (!CanRemove<Filter>::value) {
+        read_sets.resize(FILE_COUNT);
+        #pragma omp parallel for
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            MappedFile file(i == options.replaceIndex ? options.replaceWith : filenames[i]);
+            if (!file.is_open()) {
+                std::cerr << "Failed to open file" << std::endl;
+                exit(1);
             }
+            ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+                read_sets[i].insertHash(HashWord(word), word);
+            });
         }
+        vocabularies = read_sets.data();
+    }
 
-        if (existsInAny && isFalsePositive) {
-            count_false_positive++;
+    if (options.freeze == 16) {
+        RunFrozenQueries<uint16_t>(vocabularies, filterBytes, options);
+    } else {
+        RunFrozenQueries<uint8_t>(vocabularies, filterBytes, options);
+    }
+}
+/**
+ * The function MergeFrequencySketches adds the sketches of all threads into the first one. The
+ * counters are split into slices, and every thread adds up one slice of all the sketches.
+ */
+void MergeFrequencySketches() {
+    CountMinSketch& merged = frequency_sketches[0];
+    size_t slices = (merged.counterCount() + SKETCH_MERGE_SLICE - 1) / SKETCH_MERGE_SLICE;
+
+    #pragma omp parallel for
+    for (size_t s = 0; s < slices; ++s) {
+        for (size_t t = 1; t < frequency_sketches.size(); ++t) {
+            merged.merge(frequency_sketches[t], s * SKETCH_MERGE_SLICE, (s + 1) * SKETCH_MERGE_SLICE);
         }
     }
-    std::cout << "Number of false positives: " << count_false_positive << std::endl;
+    frequency_sketches.resize(1);
 }
 /**
- * The main function reads multiple files, inserts unique words into bloom filters, measures the time
- * taken for each file, and outputs the total time taken and the total number of unique words.
- * 
- * @return The main function is returning an integer value of 0.
+ * The function RunFrequencyQueries estimates how often every word of `query.txt` occurred in the
+ * books from the Count-Min sketch and checks the estimates against the count column: a word with
+ * count 0 should be estimated at 0 and one with a positive count at no less than that. To measure
+ * the overestimates, the exact counts of the distinct query words alone are then taken in one more
+ * pass over the books, which needs memory for the query words only.
+ *
+ * @param filenames The books the sketch was filled from.
  */
-int main() {
-    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
-    std::bitset<BLOOM_FILTER_SIZE> bloom_filters[FILE_COUNT];
+void RunFrequencyQueries(const std::string filenames[]) {
+    const CountMinSketch& sketch = frequency_sketches[0];
+    MappedFile query_file("query.txt");
+
+    if (!query_file.is_open()) {
+        std::cerr << "Failed to open query file" << std::endl;
+        exit(1);
+    }
+
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> estimates;
+    std::vector<long long> columns;
+    ForEachQueryPair(query_file.data(), query_file.data() + query_file.size(), [&](std::string_view word, long long count) {
+        hashes.push_back(HashWord(word));
+        columns.push_back(count);
+    });
+    estimates.resize(hashes.size());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    #pragma omp parallel for
+    for (size_t q = 0; q < hashes.size(); ++q) {
+        estimates[q] = sketch.estimateHash(hashes[q]);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    long long belowColumn = 0;
+    long long absentCounted = 0;
+    for (size_t q = 0; q < hashes.size(); ++q) {
+        belowColumn += estimates[q] < columns[q];
+        absentCounted += columns[q] == 0 && estimates[q] > 0;
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    std::cout << "Count-Min sketch: " << sketch.width() << " x " << sketch.depth() << " counters (" << sketch.bytes() / 1024.0 << " KB), "
+              << (sketch.conservative() ? "conservative" : "standard") << " update, " << sketch.total() << " words counted.\n";
+    std::cout << "Time taken to estimate " << hashes.size() << " word frequencies: " << duration << " microseconds, or approximately " << duration / 1000.0
+              << " milliseconds (" << (duration > 0 ? hashes.size() * 1e6 / duration : 0.0) << " queries per second).\n";
+    std::cout << "Against the count column: " << belowColumn << " estimates below it, " << absentCounted << " absent words with a nonzero estimate.\n";
+
+    /* exact counts of the distinct query words, by hash, for checking the estimates */
+    std::unordered_map<uint64_t, uint32_t> exact;
+    for (uint64_t hash : hashes) {
+        exact.emplace(hash, 0);
+    }
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        MappedFile file(filenames[i]);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file" << std::endl;
+            exit(1);
+        }
+        ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+            auto found = exact.find(HashWord(word));
+            if (found != exact.end()) {
+                found->second++;
+            }
+        });
+    }
+
+    size_t exactEstimates = 0;
+    uint64_t totalOver = 0;
+    uint32_t largestOver = 0;
+    for (const auto& [hash, count] : exact) {
+        uint32_t over = sketch.estimateHash(hash) - count;
+        exactEstimates += over == 0;
+        totalOver += over;
+        largestOver = std::max(largestOver, over);
+    }
+    std::cout << "Against the exact counts of the " << exact.size() << " distinct query words: " << exactEstimates * 100.0 / exact.size()
+              << "% exact, overestimate " << static_cast<double>(totalOver) / exact.size() << " on average and " << largestOver
+              << " at most (bound " << sketch.errorBound() << ").\n";
+}
+/**
+ * The function MakeFilters creates `FILE_COUNT` empty filters of the given type.
+ */
+template <typename Filter>
+std::vector<Filter> MakeFilters(FilterParams params) {
+    std::vector<Filter> bloom_filters;
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        bloom_filters.emplace_back(params);
+    }
+    return bloom_filters;
+}
+/**
+ * The function SaveAndReport writes the filters and exact sets to `options.save` and prints the time
+ * it took. The program exits if the file cannot be written or the filter type has no file format.
+ *
+ * @param bloom_filters An array of `FILE_COUNT` filters.
+ * @param filenames The files the filters were built from.
+ * @param uniqueWordsCount The number of unique words of each file.
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void SaveAndReport(const Filter bloom_filters[], const std::string filenames[], const int uniqueWordsCount[], const Options& options) {
+    if constexpr (FilterFileType<Filter>::value == 0) {
+        std::cerr << "--save is not supported with --filter=" << options.filter << std::endl;
+        exit(1);
+    } else {
+        auto saveStart = std::chrono::high_resolution_clock::now();
+        if (!SaveFilters(options.save, bloom_filters, filenames, uniqueWordsCount, exact_sets, FILE_COUNT)) {
+            exit(1);
+        }
+        auto saveEnd = std::chrono::high_resolution_clock::now();
+        auto saveDuration = std::chrono::duration_cast<std::chrono::microseconds>(saveEnd - saveStart).count();
+        std::cout << "Time taken to save " << options.save << ": " << saveDuration << " microseconds, or approximately " << saveDuration / 1000.0 << " milliseconds.\n";
+    }
+}
+/**
+ * The function RunWithFilter fills one filter per file, either one thread per file, one file at a time
+ * split across all threads when `options.chunked` is set, or all files through the read-ahead pipeline
+ * when `options.pipelined` is set, and prints the timings. The
+ * filters are saved when `options.save` is set, and then the queries are run.
+ *
+ * @param filenames The files to read, `FILE_COUNT` of them.
+ * @param bloom_filters `FILE_COUNT` empty filters, or the slices of a `BitSlicedIndex`.
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void RunWithFilter(const std::string filenames[], std::vector<Filter>& bloom_filters, const Options& options) {
+    std::cout << "Filter size: " << bloom_filters[0].bits() << " bits (" << bloom_filters[0].bytes() / 1024.0 << " KB), " << bloom_filters[0].hashes() << " hashes per word.\n";
     int uniqueWordsCount[FILE_COUNT] = {0};
     int totalUniqueWords = 0;
+    size_t bytesBefore = 0;
+    for (const auto& filter : bloom_filters) {
+        bytesBefore += filter.bytes();
+    }
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
-    #pragma omp parallel for reduction(+:totalUniqueWords)
-    /* loop that iterates over the `FILE_COUNT` number of files. For each
-    file, it measures the time taken to read the file, inserts the unique words into the corresponding
-    Bloom filter and exact set, and updates the total number of unique words. */
-    for (int i = 0; i < FILE_COUNT; ++i) {
-        auto readStart = std::chrono::high_resolution_clock::now();
-        uniqueWordsCount[i] = ReadAndInsert(filenames[i], bloom_filters[i], exact_sets[i]);
-        totalUniqueWords += uniqueWordsCount[i];
-        auto readEnd = std::chrono::high_resolution_clock::now();
-
-        auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
-        #pragma omp critical
-        {
+    if (options.pipelined) {
+        PipelineStats stats = ReadAndInsertPipelined(filenames, bloom_filters, uniqueWordsCount, options);
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            totalUniqueWords += uniqueWordsCount[i];
+        }
+        PrintPipelineStats(stats);
+    } else if (options.chunked) {
+        /* files are handled one at a time, each split across all threads. */
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            std::vector<ThreadStats> stats;
+            auto readStart = std::chrono::high_resolution_clock::now();
+            uniqueWordsCount[i] = ReadAndInsertChunked(filenames[i], bloom_filters[i], exact_sets[i], stats);
+            totalUniqueWords += uniqueWordsCount[i];
+            auto readEnd = std::chrono::high_resolution_clock::now();
+
+            auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
             std::cout << "Time taken to read " << filenames[i] << ": " << readDuration << " microseconds, or approximately " << readDuration / 1000.0 << " milliseconds.\n";
+            PrintThreadStats(stats);
+        }
+    } else {
+        #pragma omp parallel for reduction(+:totalUniqueWords)
+        /* loop that iterates over the `FILE_COUNT` number of files. For each
+        file, it measures the time taken to read the file, inserts the unique words into the corresponding
+        Bloom filter and exact set, and updates the total number of unique words. */
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            auto readStart = std::chrono::high_resolution_clock::now();
+            if (profiler) {
+                uniqueWordsCount[i] = ProfiledReadAndInsert(filenames[i], bloom_filters[i], exact_sets[i], omp_get_thread_num());
+            } else {
+                uniqueWordsCount[i] = ReadAndInsert(filenames[i], bloom_filters[i], exact_sets[i]);
+            }
+            totalUniqueWords += uniqueWordsCount[i];
+            auto readEnd = std::chrono::high_resolution_clock::now();
+
+            auto readDuration = std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count();
+            #pragma omp critical
+            {
+                std::cout << "Time taken to read " << filenames[i] << ": " << readDuration << " microseconds, or approximately " << readDuration / 1000.0 << " milliseconds.\n";
+            }
         }
     }
 
+    if (!frequency_sketches.empty()) {
+        MergeFrequencySketches();
+    }
+
     auto t2 = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
 
     std::cout << "Total time taken: " << duration << " microseconds, or approximately " << duration / 1000.0 << " milliseconds.\n";
     std::cout << "Total unique words from read files: " << totalUniqueWords << std::endl;
 
-    QueryBloomFilters("query.txt", bloom_filters, exact_sets, FILE_COUNT);
+    size_t bytesAfter = 0;
+    for (const auto& filter : bloom_filters) {
+        bytesAfter += filter.bytes();
+    }
+    if (bytesAfter != bytesBefore) {
+        std::cout << "Filters grew from " << bytesBefore / 1024.0 << " KB to " << bytesAfter / 1024.0 << " KB in total.\n";
+    }
+    if constexpr (std::is_same_v<Filter, CuckooFilter>) {
+        for (int i = 0; i < FILE_COUNT; ++i) {
+            if (bloom_filters[i].dropped() > 0) {
+                std::cerr << "Cuckoo filter of " << filenames[i] << " is full: " << bloom_filters[i].dropped() << " words were dropped" << std::endl;
+            }
+        }
+    }
+
+    /* after --replace the filters describe the new file, so that is the name and count to save */
+    std::string currentNames[FILE_COUNT];
+    std::copy(filenames, filenames + FILE_COUNT, currentNames);
+    if (options.replaceIndex >= 0) {
+        ReplaceAndReport(bloom_filters.data(), currentNames, uniqueWordsCount, options);
+    }
+
+    if (!options.save.empty()) {
+        SaveAndReport(bloom_filters.data(), currentNames, uniqueWordsCount, options);
+    }
+
+    RunQueries(bloom_filters.data(), options);
+    if (!frequency_sketches.empty()) {
+        RunFrequencyQueries(filenames);
+    }
+    if (options.freeze > 0) {
+        FreezeAndQuery(bloom_filters.data(), filenames, options);
+    }
+}
+/**
+ * The function LoadAndQuery uses the filters saved in a filter file instead of reading the books: the
+ * filters are views into the mapped file and the exact sets are rebuilt from the saved words, then the
+ * queries are run as usual. A file saved by `bfparallel` holds no words; its filters then answer the
+ * queries alone and the accepted queries are counted without telling false positives apart.
+ *
+ * @param filterFile The opened filter file. Its filter type must match `Filter`.
+ * @param options The settings from the command line.
+ */
+template <typename Filter>
+void LoadAndQuery(const FilterFile& filterFile, const Options& options) {
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    std::vector<Filter> bloom_filters;
+    int totalUniqueWords = 0;
+
+    for (int i = 0; i < filterFile.fileCount(); ++i) {
+        bloom_filters.push_back(filterFile.filter<Filter>(i));
+        if (filterFile.hasWords()) {
+            std::string_view words = filterFile.words(i);
+            exact_sets[i].reserve(filterFile.uniqueWords(i));
+            ForEachWord(words.data(), words.data() + words.size(), [&](std::string_view word) {
+                exact_sets[i].insert(word);
+            });
+        }
+        totalUniqueWords += filterFile.uniqueWords(i);
+    }
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+
+    auto loadDuration = std::chrono::duration_cast<std::chrono::microseconds>(loadEnd - loadStart).count();
+    std::cout << "Filter size: " << bloom_filters[0].bits() << " bits (" << bloom_filters[0].bytes() / 1024.0 << " KB), " << bloom_filters[0].hashes() << " hashes per word.\n";
+    std::cout << "Time taken to load " << options.load << ": " << loadDuration << " microseconds, or approximately " << loadDuration / 1000.0 << " milliseconds.\n";
+    std::cout << "Total unique words from saved files: " << totalUniqueWords << std::endl;
+
+    RunQueries(bloom_filters.data(), options, filterFile.fileCount(), filterFile.hasWords());
+    if (options.freeze > 0) {
+        FreezeAndQuery(bloom_filters.data(), nullptr, options);
+    }
+}
+/**
+ * The main function reads multiple files, inserts unique words into bloom filters, measures the time
+ * taken for each file, and outputs the total time taken and the total number of unique words. With
+ * `--chunked` the files are read one after the other and every thread works on a byte range of the
+ * current file, with per-thread throughput printed.
+ * `--filter=blocked` selects the cache-line blocked filter instead of the classic one,
+ * `--filter=counting` a counting filter that supports removal, `--filter=scalable` a filter that adds
+ * stages as it fills (the sizes below are then those of its first stage), and `--filter=sliced` keeps
+ * all files in one `BitSlicedIndex` that answers a query with one AND per probe, and `--filter=cuckoo`
+ * a cuckoo filter with 16-bit fingerprints that supports removal and reads two buckets per lookup
+ * (`--bits=` is then its memory, and `--expected-words=` sizes it without `--fp-rate=`). Each filter has
+ * `BLOOM_FILTER_SIZE` bits and `HASH_COUNT` probes unless `--bits=`/`--hashes=` are given, or
+ * `--expected-words=` (distinct words per file) with an optional `--fp-rate=` (default 0.01) to size
+ * it from the vocabulary. `--expected-words=auto` takes the vocabulary from a HyperLogLog pass over
+ * the files instead. `--query-batch=N` sets how many queries are hashed and prefetched together
+ * (default `QUERY_BATCH_SIZE`, 1 turns batching off, at most `MAX_QUERY_BATCH`). `--save=PATH` writes the filters and exact
+ * words to a filter file after reading the books; `--load=PATH` skips the books and queries the
+ * filters saved in PATH instead, so the options that read, change or save the books are refused with it. `--replace=N:PATH` (counting and cuckoo filters only) updates file N in place
+ * with the contents of PATH before the queries are run, and `--save` then records PATH for file N. `--freeze[=8|16]` then builds a static binary fuse filter
+ * of the distinct words of every file with 8-bit (default) or 16-bit entries and runs the queries a
+ * second time against those; with `--load` it needs a counting filter file. `--profile[=PATH]` reads the books and answers the queries in
+ * separate passes (read, tokenize, hash, insert, query, verify) and prints the hardware counters of
+ * each pass on each thread, also writing them as JSON to PATH if given. `--count-min` also counts
+ * every word into a Count-Min sketch per thread (`--count-min-width=`, default `CMS_WIDTH`,
+ * `--count-min-depth=` 1 to `CMS_MAX_DEPTH`, default `CMS_DEPTH`, and `--conservative` for conservative update), merges
+ * them after reading, and estimates the frequency of every query word. `--pipelined` reads all files
+ * through a ring of `--pipeline-depth=` (default `PIPELINE_DEPTH`) buffers of `--pipeline-buffer=`
+ * bytes (default `PIPELINE_BUFFER_SIZE`) that are filled ahead of the threads with io_uring, or with
+ * a pool of `pread` threads when io_uring is not available or `--io=pread` is given.
+ * 
+ * @return The main function is returning an integer value of 0.
+ */
+int main(int argc, char* argv[]) {
+    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
+    Options options;
+    double expectedWords = 0;
+    double fpRate = 0.01;
+    bool autoSize = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--chunked") {
+            options.chunked = true;
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            options.filter = arg.substr(9);
+        } else if (arg.rfind("--bits=", 0) == 0) {
+            unsigned long long bits = 0;
+            if (!ParseUnsigned(arg.substr(7), 1, UINT32_MAX, bits)) {
+                std::cerr << "Invalid value: " << arg << " (--bits takes 1 to 4294967295)" << std::endl;
+                return 1;
+            }
+            options.params.bits = static_cast<uint32_t>(bits);
+        } else if (arg.rfind("--hashes=", 0) == 0) {
+            unsigned long long hashes = 0;
+            if (!ParseUnsigned(arg.substr(9), 1, MAX_HASH_COUNT, hashes)) {
+                std::cerr << "Invalid value: " << arg << " (--hashes takes 1 to " << MAX_HASH_COUNT << ")" << std::endl;
+                return 1;
+            }
+            options.params.hashes = static_cast<int>(hashes);
+        } else if (arg == "--expected-words=auto") {
+            autoSize = true;
+        } else if (arg.rfind("--expected-words=", 0) == 0) {
+            if (!ParseReal(arg.substr(17), expectedWords) || expectedWords < 1) {
+                std::cerr << "Invalid value: " << arg << " (--expected-words takes a count of at least 1, or auto)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--fp-rate=", 0) == 0) {
+            if (!ParseReal(arg.substr(10), fpRate) || fpRate <= 0 || fpRate >= 1) {
+                std::cerr << "Invalid value: " << arg << " (--fp-rate takes a rate between 0 and 1, exclusive)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--query-batch=", 0) == 0) {
+            unsigned long long batch = 0;
+            if (!ParseUnsigned(arg.substr(14), 1, MAX_QUERY_BATCH, batch)) {
+                std::cerr << "Invalid value: " << arg << " (--query-batch takes 1 to " << MAX_QUERY_BATCH << ")" << std::endl;
+                return 1;
+            }
+            options.queryBatch = static_cast<int>(batch);
+        } else if (arg.rfind("--save=", 0) == 0) {
+            options.save = arg.substr(7);
+        } else if (arg.rfind("--load=", 0) == 0) {
+            options.load = arg.substr(7);
+        } else if (arg == "--freeze") {
+            options.freeze = 8;
+        } else if (arg.rfind("--freeze=", 0) == 0) {
+            unsigned long long bits = 0;
+            if (!ParseUnsigned(arg.substr(9), 8, 16, bits) || (bits != 8 && bits != 16)) {
+                std::cerr << "Invalid value: " << arg << " (--freeze takes 8 or 16 bits per entry)" << std::endl;
+                return 1;
+            }
+            options.freeze = static_cast<int>(bits);
+        } else if (arg == "--pipelined") {
+            options.pipelined = true;
+        } else if (arg.rfind("--pipeline-buffer=", 0) == 0) {
+            options.pipelined = true;
+            unsigned long long bytes = 0;
+            if (!ParseUnsigned(arg.substr(18), PIPELINE_CARRY_SIZE, PIPELINE_MAX_BUFFER_SIZE, bytes)) {
+                std::cerr << "Invalid value: " << arg << " (--pipeline-buffer takes " << PIPELINE_CARRY_SIZE << " to " << PIPELINE_MAX_BUFFER_SIZE << " bytes)" << std::endl;
+                return 1;
+            }
+            options.pipelineBuffer = bytes;
+        } else if (arg.rfind("--pipeline-depth=", 0) == 0) {
+            options.pipelined = true;
+            unsigned long long depth = 0;
+            if (!ParseUnsigned(arg.substr(17), 1, PIPELINE_MAX_DEPTH, depth)) {
+                std::cerr << "Invalid value: " << arg << " (--pipeline-depth takes 1 to " << PIPELINE_MAX_DEPTH << ")" << std::endl;
+                return 1;
+            }
+            options.pipelineDepth = static_cast<int>(depth);
+        } else if (arg == "--io=pread") {
+            options.uring = false;
+        } else if (arg == "--io=uring") {
+            options.uring = true;
+        } else if (arg == "--count-min") {
+            options.countMin = true;
+        } else if (arg.rfind("--count-min-width=", 0) == 0) {
+            unsigned long long width;
+            if (!ParseUnsigned(arg.substr(18), 1, UINT32_MAX, width)) {
+                std::cerr << "Invalid value: " << arg << " (--count-min-width takes 1 to " << UINT32_MAX << " counters)" << std::endl;
+                return 1;
+            }
+            options.countMin = true;
+            options.countMinWidth = width;
+        } else if (arg.rfind("--count-min-depth=", 0) == 0) {
+            unsigned long long depth;
+            if (!ParseUnsigned(arg.substr(18), 1, CMS_MAX_DEPTH, depth)) {
+                std::cerr << "Invalid value: " << arg << " (--count-min-depth takes 1 to " << CMS_MAX_DEPTH << " rows)" << std::endl;
+                return 1;
+            }
+            options.countMin = true;
+            options.countMinDepth = depth;
+        } else if (arg == "--conservative") {
+            options.conservative = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg.rfind("--profile=", 0) == 0) {
+            options.profile = true;
+            options.profileOutput = arg.substr(10);
+        } else if (arg.rfind("--replace=", 0) == 0 && arg.find(':') != std::string::npos) {
+            size_t colon = arg.find(':');
+            unsigned long long index = 0;
+            if (!ParseUnsigned(arg.substr(10, colon - 10), 0, FILE_COUNT - 1, index) || colon + 1 == arg.size()) {
+                std::cerr << "Invalid value: " << arg << " (--replace takes N:PATH with N from 0 to " << FILE_COUNT - 1 << ")" << std::endl;
+                return 1;
+            }
+            options.replaceIndex = static_cast<int>(index);
+            options.replaceWith = arg.substr(colon + 1);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.freeze != 0 && options.freeze != 8 && options.freeze != 16) {
+        std::cerr << "--freeze takes 8 or 16 bits per entry" << std::endl;
+        return 1;
+    }
+    if (options.profile && (options.chunked || options.pipelined || options.filter == "sliced")) {
+        std::cerr << "--profile needs the per-file ingest and per-file filters; it cannot be combined with --chunked, --pipelined or --filter=sliced" << std::endl;
+        return 1;
+    }
+    if (options.chunked && options.pipelined) {
+        std::cerr << "--chunked and --pipelined are two different ingest modes; pick one" << std::endl;
+        return 1;
+    }
+    if (!options.load.empty() && (options.replaceIndex >= 0 || !options.save.empty() || options.chunked || options.pipelined)) {
+        std::cerr << "--load skips reading the books; it cannot be combined with --replace, --save, --chunked or --pipelined" << std::endl;
+        return 1;
+    }
+    if (options.profile) {
+        profiler.reset(new PhaseProfiler(omp_get_max_threads()));
+    }
+    if (options.countMin && (!options.load.empty() || options.replaceIndex >= 0)) {
+        std::cerr << "--count-min counts the books as they are read; it cannot be combined with --load or --replace" << std::endl;
+        return 1;
+    }
+    if (options.conservative && !options.countMin) {
+        std::cerr << "--conservative needs --count-min" << std::endl;
+        return 1;
+    }
+    if (options.countMin) {
+        frequency_sketches.assign(omp_get_max_threads(), CountMinSketch(options.countMinWidth, options.countMinDepth, options.conservative));
+    }
+
+    /* sizing from the expected vocabulary overrides --bits and --hashes */
+    if (autoSize) {
+        expectedWords = LargestVocabulary(filenames, FILE_COUNT);
+    }
+    if (expectedWords > 0) {
+        options.params = options.filter == "cuckoo" ? CuckooFilter::ParamsFor(expectedWords) : OptimalParams(expectedWords, fpRate);
+    }
+
+    if (!options.load.empty()) {
+        FilterFile filterFile(options.load);
+
+        if (!filterFile.is_open()) {
+            std::cerr << "Failed to load filter file: " << filterFile.errorMessage() << std::endl;
+            return 1;
+        }
+        if (filterFile.fileCount() < 1 || filterFile.fileCount() > FILE_COUNT) {
+            std::cerr << "Filter file must hold 1 to " << FILE_COUNT << " filters" << std::endl;
+            return 1;
+        }
+        if (options.freeze > 0 && (!filterFile.hasWords() || filterFile.fileCount() != FILE_COUNT)) {
+            std::cerr << "--freeze with --load needs all " << FILE_COUNT << " filters with their exact words, which a file saved by bfparallel leaves out" << std::endl;
+            return 1;
+        }
+        if (options.freeze > 0 && filterFile.filterType() != FilterFileType<CountingBloomFilter>::value) {
+            std::cerr << "--freeze with --load needs a counting filter file; the saved words of other filters leave out their false positives" << std::endl;
+            return 1;
+        }
+        if (filterFile.filterType() == FilterFileType<BloomFilter>::value) {
+            LoadAndQuery<BloomFilter>(filterFile, options);
+        } else if (filterFile.filterType() == FilterFileType<BlockedBloomFilter>::value) {
+            LoadAndQuery<BlockedBloomFilter>(filterFile, options);
+        } else if (filterFile.filterType() == FilterFileType<CountingBloomFilter>::value) {
+            LoadAndQuery<CountingBloomFilter>(filterFile, options);
+        } else {
+            std::cerr << "Unknown filter type in " << options.load << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (options.filter == "classic") {
+        std::vector<BloomFilter> bloom_filters = MakeFilters<BloomFilter>(options.params);
+        RunWithFilter(filenames, bloom_filters, options);
+    } else if (options.filter == "blocked") {
+        std::vector<BlockedBloomFilter> bloom_filters = MakeFilters<BlockedBloomFilter>(options.params);
+        RunWithFilter(filenames, bloom_filters, options);
+    } else if (options.filter == "counting") {
+        std::vector<CountingBloomFilter> bloom_filters = MakeFilters<CountingBloomFilter>(options.params);
+        RunWithFilter(filenames, bloom_filters, options);
+    } else if (options.filter == "scalable") {
+        std::vector<ScalableBloomFilter> bloom_filters = MakeFilters<ScalableBloomFilter>(options.params);
+        RunWithFilter(filenames, bloom_filters, options);
+    } else if (options.filter == "cuckoo") {
+        std::vector<CuckooFilter> bloom_filters = MakeFilters<CuckooFilter>(options.params);
+        RunWithFilter(filenames, bloom_filters, options);
+    } else if (options.filter == "sliced") {
+        BitSlicedIndex index(options.params, FILE_COUNT);
+        std::vector<BitSlicedIndex::Slice> slices = index.slices();
+        RunWithFilter(filenames, slices, options);
+    } else {
+        std::cerr << "Unknown filter: " << options.filter << std::endl;
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,185 @@
+#ifndef BITSLICEDINDEX_H
+#define BITSLICEDINDEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "bloomfilter.h"
+
+/**
+ * A bit-sliced signature index: the Bloom filters of many files stored transposed, so that each of the
+ * `bits` probe positions is a row holding one membership bit per file. A word is looked up by ANDing
+ * the `hashes` rows it probes, which gives the set of files that may contain it in `hashes` row reads
+ * no matter how many files there are. Every file behaves exactly like a `BloomFilter` with the same
+ * parameters: the probe positions are the same, only the layout differs.
+ *
+ * Rows are `rowBits` wide. With up to 64 files that is the file count rounded up to a power of two,
+ * so several rows share a 64-bit word and three files cost 4 bits per position; above 64 files a row
+ * is a whole number of words. A row never straddles a word, so a row read is one cache line for up to
+ * 512 files. Inserts use `fetch_or` like `BloomFilter`, so threads may insert into different files or
+ * the same file at once.
+ */
+class BitSlicedIndex {
+public:
+    /**
+     * A handle for one file in the index with the insert interface of a single filter, so that the
+     * code that fills per-file filters can fill the index too.
+     */
+    class Slice {
+    public:
+        Slice(BitSlicedIndex& index, int file) : owner(&index), fileIndex(file) {}
+
+        const BitSlicedIndex& index() const { return *owner; }
+        int file() const { return fileIndex; }
+        uint32_t bits() const { return owner->bits(); }
+        int hashes() const { return owner->hashes(); }
+        size_t bytes() const { return owner->bytes() / owner->fileCount(); }
+
+        bool insert(std::string_view word) { return owner->insertHash(fileIndex, HashWord(word)); }
+        bool insertHash(uint64_t hash) { return owner->insertHash(fileIndex, hash); }
+        bool contains(std::string_view word) const { return owner->containsHash(fileIndex, HashWord(word)); }
+        bool containsHash(uint64_t hash) const { return owner->containsHash(fileIndex, hash); }
+
+    private:
+        BitSlicedIndex* owner;
+        int fileIndex;
+    };
+
+    BitSlicedIndex(FilterParams params, int fileCount)
+        : bitCount(params.bits), hashCount(params.hashes), files(fileCount),
+          rowBitCount(RowBitsFor(fileCount)),
+          storage((static_cast<uint64_t>(params.bits) * rowBitCount + 63) / 64) {}
+
+    uint32_t bits() const { return bitCount; }
+    int hashes() const { return hashCount; }
+    int fileCount() const { return files; }
+    unsigned int rowBits() const { return rowBitCount; }
+    size_t bytes() const { return storage.size() * sizeof(uint64_t); }
+
+    /* number of 64-bit words in a candidate mask */
+    int maskWords() const { return (files + 63) / 64; }
+
+    /**
+     * The function `slices` returns one `Slice` per file, in file order.
+     */
+    std::vector<Slice> slices() {
+        std::vector<Slice> result;
+        for (int i = 0; i < files; ++i) {
+            result.emplace_back(*this, i);
+        }
+        return result;
+    }
+
+    /**
+     * The function `insertHash` sets the bits of a word in one file's column and reports whether any
+     * of them was newly set, with the same concurrency caveat as `BloomFilter::insert`.
+     *
+     * @param file The file the word belongs to, in the range [0, fileCount()).
+     * @param hash The `HashWord` value of the word.
+     *
+     * @return true if at least one bit was not set before the call.
+     */
+    bool insertHash(int file, uint64_t hash) {
+        bool seen = true;
+        for (int i = 0; i < hashCount; ++i) {
+            uint64_t bit = RowStart(ProbePosition(hash, i, bitCount)) + file;
+            uint64_t mask = uint64_t(1) << (bit & 63);
+            std::atomic<uint64_t>& word = storage[bit >> 6];
+            if (!(word.load(std::memory_order_relaxed) & mask) &&
+                !(word.fetch_or(mask, std::memory_order_relaxed) & mask)) {
+                seen = false;
+            }
+        }
+        return !seen;
+    }
+
+    /**
+     * The function `containsHash` checks one file's column only, like `BloomFilter::containsHash`.
+     */
+    bool containsHash(int file, uint64_t hash) const {
+        for (int i = 0; i < hashCount; ++i) {
+            uint64_t bit = RowStart(ProbePosition(hash, i, bitCount)) + file;
+            if (!((storage[bit >> 6].load(std::memory_order_relaxed) >> (bit & 63)) & 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The function `candidatesHash` finds every file whose filter contains a word by ANDing the rows
+     * the word probes. It stops early once no file is left.
+     *
+     * @param hash The `HashWord` value of the word.
+     * @param mask Receives `maskWords()` words; bit f of the mask is set when file f may contain the
+     * word.
+     *
+     * @return true if at least one file may contain the word.
+     */
+    bool candidatesHash(uint64_t hash, uint64_t mask[]) const {
+        const int words = maskWords();
+        uint64_t any = 0;
+
+        for (int w = 0; w < words; ++w) {
+            mask[w] = ~uint64_t(0);
+        }
+        for (int i = 0; i < hashCount; ++i) {
+            uint64_t start = RowStart(ProbePosition(hash, i, bitCount));
+            const std::atomic<uint64_t>* row = &storage[start >> 6];
+            unsigned int shift = start & 63;
+
+            any = 0;
+            for (int w = 0; w < words; ++w) {
+                mask[w] &= row[w].load(std::memory_order_relaxed) >> shift;
+                any |= mask[w];
+            }
+            if (any == 0) {
+                return false;
+            }
+        }
+
+        /* the bits above the last file belong to the next rows when rows share a word */
+        if (files % 64 != 0) {
+            mask[words - 1] &= (uint64_t(1) << (files % 64)) - 1;
+            any = 0;
+            for (int w = 0; w < words; ++w) {
+                any |= mask[w];
+            }
+        }
+        return any != 0;
+    }
+
+    /**
+     * The function `prefetch` starts loading the rows a later `candidatesHash(hash)` will read.
+     */
+    void prefetch(uint64_t hash) const {
+        for (int i = 0; i < hashCount; ++i) {
+            __builtin_prefetch(&storage[RowStart(ProbePosition(hash, i, bitCount)) >> 6]);
+        }
+    }
+
+private:
+    /* smallest power of two that holds `fileCount` bits up to 64, whole words above that */
+    static unsigned int RowBitsFor(int fileCount) {
+        unsigned int rowBits = 1;
+        while (rowBits < 64 && rowBits < static_cast<unsigned int>(fileCount)) {
+            rowBits *= 2;
+        }
+        return rowBits < 64 ? rowBits : (fileCount + 63) / 64 * 64;
+    }
+
+    /* index of the first bit of a row in `storage` */
+    uint64_t RowStart(uint32_t row) const {
+        return static_cast<uint64_t>(row) * rowBitCount;
+    }
+
+    uint32_t bitCount;
+    int hashCount;
+    int files;
+    unsigned int rowBitCount;
+    std::vector<std::atomic<uint64_t>> storage;
+};
+
+#endif
@@ -0,0 +1,694 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "bloomhash.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && std::atomic<uint64_t>::is_always_lock_free,
+              "filters are saved and mapped as plain 64-bit words");
+
+/* Size of a filter in bits and the number of probes per word. */
+struct FilterParams {
+    uint32_t bits = BLOOM_FILTER_SIZE;
+    int hashes = HASH_COUNT;
+};
+
+/**
+ * The function OptimalParams picks the number of bits m and probes k for a filter that should hold
+ * `expectedWords` distinct words at a false positive rate of `fpRate`, using the textbook formulas
+ * m = -n ln p / (ln 2)^2 and k = (m / n) ln 2.
+ *
+ * @param expectedWords The number of distinct words the filter is expected to hold.
+ * @param fpRate The target false positive rate, between 0 and 1.
+ *
+ * @return the filter size and probe count. The size is capped at 2^32 - 1 bits.
+ */
+inline FilterParams OptimalParams(double expectedWords, double fpRate) {
+    const double ln2 = std::log(2.0);
+    FilterParams params;
+    double n = std::max(expectedWords, 1.0);
+    double m = std::ceil(-n * std::log(fpRate) / (ln2 * ln2));
+
+    params.bits = static_cast<uint32_t>(std::min(std::max(m, 64.0), 4294967295.0));
+    params.hashes = std::max(1, static_cast<int>(std::lround(params.bits / n * ln2)));
+    return params;
+}
+
+/**
+ * The function OrWords ORs `count` 64-bit words of `src` into `dst`, 256 bits per instruction with
+ * AVX2 (`-mavx2` or `-march=native`), 128 with SSE2 otherwise on x86-64, and 64 everywhere else. It
+ * is the inner loop of merging two filters.
+ *
+ * @param dst The words to update.
+ * @param src The words to OR in; must not overlap `dst`.
+ * @param count The number of words.
+ */
+inline void OrWords(uint64_t* dst, const uint64_t* src, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= count; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(a, b));
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= count; i += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(a, b));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] |= src[i];
+    }
+}
+
+/**
+ * The function EstimateFromSetBits estimates how many distinct words were inserted into `bits` bits
+ * with `hashes` probes each from the number of bits that are set, as -(m / k) ln(1 - X / m).
+ */
+inline double EstimateFromSetBits(double setBits, double bits, int hashes) {
+    if (setBits >= bits) {
+        setBits = bits - 0.5;
+    }
+    return -bits / hashes * std::log1p(-setBits / bits);
+}
+
+/**
+ * A Bloom filter stored as 64-bit atomic words, so that several threads can insert into the same
+ * filter at once. A plain `std::bitset` cannot be shared this way because setting one bit rewrites the
+ * whole word that contains it. The size and the number of probes are chosen when the filter is
+ * created; the default is `BLOOM_FILTER_SIZE` bits and `HASH_COUNT` probes.
+ */
+class BloomFilter {
+public:
+    explicit BloomFilter(FilterParams params = FilterParams())
+        : bitCount(params.bits), hashCount(params.hashes), storage((params.bits + 63ull) / 64),
+          words(storage.data()) {}
+
+    /**
+     * This constructor makes a read-only view over filter bits that were written out from `data()`,
+     * for example in a mapped filter file. Nothing is copied; the memory must outlive the filter and
+     * the filter must not be inserted into.
+     */
+    BloomFilter(FilterParams params, const void* mapped)
+        : bitCount(params.bits), hashCount(params.hashes),
+          words(static_cast<std::atomic<uint64_t>*>(const_cast<void*>(mapped))) {}
+
+    uint32_t bits() const { return bitCount; }
+    int hashes() const { return hashCount; }
+    size_t bytes() const { return (bitCount + 63ull) / 64 * sizeof(uint64_t); }
+    size_t wordCount() const { return (bitCount + 63ull) / 64; }
+    const void* data() const { return words; }
+
+    /**
+     * The function `test` checks whether the bit at a given position is set.
+     *
+     * @param pos The bit position, in the range [0, bits()).
+     *
+     * @return true if the bit is set.
+     */
+    bool test(uint32_t pos) const {
+        return (words[pos >> 6].load(std::memory_order_relaxed) >> (pos & 63)) & 1;
+    }
+
+    /**
+     * The function `testAndSet` sets the bit at a given position and reports whether it was already
+     * set. The plain load skips the locked read-modify-write for bits that are already set, which is
+     * the common case once a filter has seen most of a vocabulary.
+     *
+     * @param pos The bit position, in the range [0, bits()).
+     *
+     * @return true if the bit was set before the call.
+     */
+    bool testAndSet(uint32_t pos) {
+        uint64_t mask = uint64_t(1) << (pos & 63);
+        std::atomic<uint64_t>& word = words[pos >> 6];
+        if (word.load(std::memory_order_relaxed) & mask) {
+            return true;
+        }
+        return word.fetch_or(mask, std::memory_order_relaxed) & mask;
+    }
+
+    /**
+     * The function `contains` checks whether all bits of a word are set in the filter.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is probably in the filter, false if it is definitely not.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word));
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash) const {
+        for (int i = 0; i < hashCount; ++i) {
+            if (!test(ProbePosition(hash, i, bitCount))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The function `prefetch` asks the CPU to start loading every word a later `containsHash(hash)`
+     * will read, so that the cache misses of a batch of lookups overlap instead of following each
+     * other.
+     */
+    void prefetch(uint64_t hash) const {
+        for (int i = 0; i < hashCount; ++i) {
+            __builtin_prefetch(&words[ProbePosition(hash, i, bitCount) >> 6]);
+        }
+    }
+
+    /**
+     * The function `insert` sets all bits of a word and reports whether any of them was newly set,
+     * i.e. whether the filter considered the word new. When two threads insert the same unseen word
+     * at the same moment both may report it as new, so unique counts from concurrent inserts can be
+     * very slightly high.
+     *
+     * @param word The word to insert. Case is ignored.
+     *
+     * @return true if at least one bit was not set before the call.
+     */
+    bool insert(std::string_view word) {
+        return insertHash(HashWord(word));
+    }
+
+    /**
+     * The function `insertHash` is `insert` for a word whose `HashWord` value is already known.
+     */
+    bool insertHash(uint64_t hash) {
+        bool seen = true;
+        for (int i = 0; i < hashCount; ++i) {
+            seen = testAndSet(ProbePosition(hash, i, bitCount)) && seen;
+        }
+        return !seen;
+    }
+
+    /**
+     * The function `merge` ORs words [begin, end) of another filter with the same size and probe count
+     * into this one, so that this part of the filter then holds every word inserted into either. A
+     * whole filter is merged by covering 0 to `wordCount()`, possibly in slices on several threads. No
+     * thread may insert into either filter while it runs.
+     */
+    void merge(const BloomFilter& other, size_t begin, size_t end) {
+        OrWords(reinterpret_cast<uint64_t*>(words) + begin, reinterpret_cast<const uint64_t*>(other.words) + begin, end - begin);
+    }
+
+    /**
+     * The function `estimateCount` estimates the number of distinct words in the filter from the
+     * number of set bits, for filters built without counting inserts, such as merged ones.
+     */
+    double estimateCount() const {
+        uint64_t setBits = 0;
+        for (size_t i = 0; i < wordCount(); ++i) {
+            setBits += __builtin_popcountll(words[i].load(std::memory_order_relaxed));
+        }
+        return EstimateFromSetBits(setBits, bitCount, hashCount);
+    }
+
+private:
+    uint32_t bitCount;
+    int hashCount;
+    std::vector<std::atomic<uint64_t>> storage;
+    std::atomic<uint64_t>* words;
+};
+
+/**
+ * A blocked Bloom filter: the filter is cut into 64-byte blocks (one cache line each), the low half of
+ * the word hash picks one block and all probes of a word land inside that block, so an insert or
+ * lookup touches a single cache line instead of one per probe. The price is a somewhat higher false
+ * positive rate, because words that share a block compete for its 512 bits. The requested size is
+ * rounded up to a whole number of blocks.
+ */
+class BlockedBloomFilter {
+public:
+    static const unsigned int BLOCK_BITS = 512;
+
+    explicit BlockedBloomFilter(FilterParams params = FilterParams())
+        : blockCount(BlockCountFor(params.bits)), hashCount(params.hashes), storage(blockCount),
+          blocks(storage.data()) {}
+
+    /**
+     * This constructor makes a read-only view over blocks that were written out from `data()`, with
+     * the same rules as the `BloomFilter` one. `mapped` must be 64-byte aligned.
+     */
+    BlockedBloomFilter(FilterParams params, const void* mapped)
+        : blockCount(BlockCountFor(params.bits)), hashCount(params.hashes),
+          blocks(static_cast<Block*>(const_cast<void*>(mapped))) {}
+
+    uint32_t bits() const { return blockCount * BLOCK_BITS; }
+    int hashes() const { return hashCount; }
+    size_t bytes() const { return blockCount * sizeof(Block); }
+    size_t wordCount() const { return blockCount * (BLOCK_BITS / 64); }
+    const void* data() const { return blocks; }
+
+    /**
+     * The function `contains` checks whether all probe bits of a word are set in its block.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is probably in the filter, false if it is definitely not.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word));
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash) const {
+        const Block& block = blocks[FastRange(static_cast<uint32_t>(hash), blockCount)];
+
+        for (int i = 0; i < hashCount; ++i) {
+            unsigned int bit = InBlockPosition(hash, i);
+            if (!((block.words[bit >> 6].load(std::memory_order_relaxed) >> (bit & 63)) & 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The function `prefetch` starts loading the one block a later `containsHash(hash)` will read.
+     */
+    void prefetch(uint64_t hash) const {
+        __builtin_prefetch(&blocks[FastRange(static_cast<uint32_t>(hash), blockCount)]);
+    }
+
+    /**
+     * The function `insert` sets all probe bits of a word in its block and reports whether any of them
+     * was newly set, with the same concurrency caveat as `BloomFilter::insert`.
+     *
+     * @param word The word to insert. Case is ignored.
+     *
+     * @return true if at least one bit was not set before the call.
+     */
+    bool insert(std::string_view word) {
+        return insertHash(HashWord(word));
+    }
+
+    /**
+     * The function `insertHash` is `insert` for a word whose `HashWord` value is already known.
+     */
+    bool insertHash(uint64_t hash) {
+        Block& block = blocks[FastRange(static_cast<uint32_t>(hash), blockCount)];
+        bool seen = true;
+
+        for (int i = 0; i < hashCount; ++i) {
+            unsigned int bit = InBlockPosition(hash, i);
+            uint64_t mask = uint64_t(1) << (bit & 63);
+            std::atomic<uint64_t>& w = block.words[bit >> 6];
+            if (!(w.load(std::memory_order_relaxed) & mask) &&
+                !(w.fetch_or(mask, std::memory_order_relaxed) & mask)) {
+                seen = false;
+            }
+        }
+        return !seen;
+    }
+
+    /**
+     * The function `merge` ORs words [begin, end) of another filter with the same size and probe count
+     * into this one, with the same rules as `BloomFilter::merge`. The blocks are contiguous, so the
+     * range does not have to follow block boundaries.
+     */
+    void merge(const BlockedBloomFilter& other, size_t begin, size_t end) {
+        OrWords(reinterpret_cast<uint64_t*>(blocks) + begin, reinterpret_cast<const uint64_t*>(other.blocks) + begin, end - begin);
+    }
+
+    /**
+     * The function `estimateCount` estimates the number of distinct words in the filter. Every block is
+     * a small Bloom filter of its own, so the estimate is summed block by block.
+     */
+    double estimateCount() const {
+        double count = 0;
+        for (uint32_t b = 0; b < blockCount; ++b) {
+            int setBits = 0;
+            for (const auto& w : blocks[b].words) {
+                setBits += __builtin_popcountll(w.load(std::memory_order_relaxed));
+            }
+            count += EstimateFromSetBits(setBits, BLOCK_BITS, hashCount);
+        }
+        return count;
+    }
+
+private:
+    struct alignas(64) Block {
+        std::atomic<uint64_t> words[BLOCK_BITS / 64];
+    };
+
+    /**
+     * The function InBlockPosition derives probe i inside the block from the high half of the hash as
+     * a + i * b (mod 512), with a taken from its low bits and an odd step b from bits 16 and up, so the
+     * probes of one word never collide with each other.
+     */
+    static unsigned int InBlockPosition(uint64_t hash, int i) {
+        uint32_t high = static_cast<uint32_t>(hash >> 32);
+        return (high + i * ((high >> 16) | 1)) % BLOCK_BITS;
+    }
+
+    /* number of whole blocks needed for `bits`, at least one and small enough for bits() to fit */
+    static uint32_t BlockCountFor(uint32_t bits) {
+        uint64_t count = (bits + (BLOCK_BITS - 1ull)) / BLOCK_BITS;
+        return static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(count, 1), 0xffffffffull / BLOCK_BITS));
+    }
+
+    uint32_t blockCount;
+    int hashCount;
+    std::vector<Block> storage;
+    Block* blocks;
+};
+
+/**
+ * A counting Bloom filter: every position holds a 4-bit counter instead of a bit, sixteen to a 64-bit
+ * word, so words can be removed as well as inserted. It probes exactly like `BloomFilter` and a word
+ * is present when all its counters are non-zero. A counter that reaches 15 stays there for good, since
+ * its true count is no longer known; removing through it leaves it set, which can only cause a false
+ * positive, never a false negative. A word must only be removed if it was inserted, and each word
+ * should be inserted once per document (not once per occurrence) so that removing a document undoes
+ * exactly what adding it did.
+ */
+class CountingBloomFilter {
+public:
+    static const unsigned int COUNTER_BITS = 4;
+    static const unsigned int COUNTER_MAX = 15;
+
+    explicit CountingBloomFilter(FilterParams params = FilterParams())
+        : counterCount(params.bits), hashCount(params.hashes), storage((params.bits + 15ull) / 16),
+          words(storage.data()) {}
+
+    /**
+     * This constructor makes a read-only view over counters that were written out from `data()`, with
+     * the same rules as the `BloomFilter` one.
+     */
+    CountingBloomFilter(FilterParams params, const void* mapped)
+        : counterCount(params.bits), hashCount(params.hashes),
+          words(static_cast<std::atomic<uint64_t>*>(const_cast<void*>(mapped))) {}
+
+    uint32_t bits() const { return counterCount; }
+    int hashes() const { return hashCount; }
+    size_t bytes() const { return (counterCount + 15ull) / 16 * sizeof(uint64_t); }
+    const void* data() const { return words; }
+
+    /**
+     * The function `count` reads the counter at a given position.
+     *
+     * @param pos The counter position, in the range [0, bits()).
+     *
+     * @return the counter, in the range [0, COUNTER_MAX].
+     */
+    unsigned int count(uint32_t pos) const {
+        return (words[pos >> 4].load(std::memory_order_relaxed) >> Shift(pos)) & COUNTER_MAX;
+    }
+
+    /**
+     * The function `contains` checks whether all counters of a word are non-zero.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is probably in the filter, false if it is definitely not.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word));
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash) const {
+        for (int i = 0; i < hashCount; ++i) {
+            if (count(ProbePosition(hash, i, counterCount)) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The function `prefetch` starts loading every word a later `containsHash(hash)` will read.
+     */
+    void prefetch(uint64_t hash) const {
+        for (int i = 0; i < hashCount; ++i) {
+            __builtin_prefetch(&words[ProbePosition(hash, i, counterCount) >> 4]);
+        }
+    }
+
+    /**
+     * The function `insert` increments all counters of a word and reports whether any of them was
+     * zero before, i.e. whether the filter considered the word new. Threads may insert at once.
+     *
+     * @param word The word to insert. Case is ignored.
+     *
+     * @return true if at least one counter was zero before the call.
+     */
+    bool insert(std::string_view word) {
+        return insertHash(HashWord(word));
+    }
+
+    /**
+     * The function `insertHash` is `insert` for a word whose `HashWord` value is already known.
+     */
+    bool insertHash(uint64_t hash) {
+        bool seen = true;
+        for (int i = 0; i < hashCount; ++i) {
+            seen = Increment(ProbePosition(hash, i, counterCount)) && seen;
+        }
+        return !seen;
+    }
+
+    /**
+     * The function `remove` decrements all counters of a word that was inserted earlier. Saturated
+     * counters are left alone.
+     *
+     * @param word The word to remove. Case is ignored.
+     *
+     * @return true if the word is no longer in the filter, i.e. some counter dropped to zero.
+     */
+    bool remove(std::string_view word) {
+        return removeHash(HashWord(word));
+    }
+
+    /**
+     * The function `removeHash` is `remove` for a word whose `HashWord` value is already known.
+     */
+    bool removeHash(uint64_t hash) {
+        bool gone = false;
+        for (int i = 0; i < hashCount; ++i) {
+            gone = Decrement(ProbePosition(hash, i, counterCount)) || gone;
+        }
+        return gone;
+    }
+
+private:
+    static unsigned int Shift(uint32_t pos) {
+        return (pos & 15) * COUNTER_BITS;
+    }
+
+    /* adds one to a counter unless it is saturated; returns whether it was non-zero before */
+    bool Increment(uint32_t pos) {
+        std::atomic<uint64_t>& word = words[pos >> 4];
+        unsigned int shift = Shift(pos);
+        uint64_t old = word.load(std::memory_order_relaxed);
+        unsigned int counter;
+        do {
+            counter = (old >> shift) & COUNTER_MAX;
+            if (counter == COUNTER_MAX) {
+                return true;
+            }
+        } while (!word.compare_exchange_weak(old, old + (uint64_t(1) << shift), std::memory_order_relaxed));
+        return counter != 0;
+    }
+
+    /* subtracts one from a counter unless it is zero or saturated; returns whether it became zero */
+    bool Decrement(uint32_t pos) {
+        std::atomic<uint64_t>& word = words[pos >> 4];
+        unsigned int shift = Shift(pos);
+        uint64_t old = word.load(std::memory_order_relaxed);
+        unsigned int counter;
+        do {
+            counter = (old >> shift) & COUNTER_MAX;
+            if (counter == 0 || counter == COUNTER_MAX) {
+                return false;
+            }
+        } while (!word.compare_exchange_weak(old, old - (uint64_t(1) << shift), std::memory_order_relaxed));
+        return counter == 1;
+    }
+
+    uint32_t counterCount;
+    int hashCount;
+    std::vector<std::atomic<uint64_t>> storage;
+    std::atomic<uint64_t>* words;
+};
+
+/**
+ * A scalable Bloom filter: a chain of `BloomFilter` stages that grows with the data instead of being
+ * sized up front. New words go into the newest stage, and once half of its bits are set (the fill of
+ * an optimally loaded filter) a new stage is added with twice the capacity and one more probe, which
+ * halves its false positive rate. The overall false positive rate therefore stays below about twice
+ * that of the first stage however many words arrive, and memory grows with the number of distinct
+ * words rather than with a guess made in advance.
+ *
+ * The first stage uses the given parameters. Threads may insert at once; a stage that crosses the
+ * threshold while another thread is still inserting into it ends up very slightly over-full.
+ */
+class ScalableBloomFilter {
+public:
+    static const int MAX_STAGES = 32;
+
+    explicit ScalableBloomFilter(FilterParams params = FilterParams()) : state(new State) {
+        state->first = params;
+        state->stages[0].filter.reset(new BloomFilter(params));
+        state->count.store(1, std::memory_order_release);
+    }
+
+    /* total bits and bytes of all stages so far, and the probe count of the first stage */
+    uint32_t bits() const {
+        uint64_t total = 0;
+        ForEachStage([&](const BloomFilter& stage) { total += stage.bits(); });
+        return static_cast<uint32_t>(std::min<uint64_t>(total, 0xffffffffull));
+    }
+    int hashes() const { return state->first.hashes; }
+    size_t bytes() const {
+        size_t total = 0;
+        ForEachStage([&](const BloomFilter& stage) { total += stage.bytes(); });
+        return total;
+    }
+    int stageCount() const { return state->count.load(std::memory_order_acquire); }
+
+    /**
+     * The function `contains` checks whether a word is in any stage.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is probably in the filter, false if it is definitely not.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word));
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash) const {
+        int count = stageCount();
+        for (int s = 0; s < count; ++s) {
+            if (state->stages[s].filter->containsHash(hash)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * The function `prefetch` prefetches the probes of every stage.
+     */
+    void prefetch(uint64_t hash) const {
+        ForEachStage([&](const BloomFilter& stage) { stage.prefetch(hash); });
+    }
+
+    /**
+     * The function `insert` adds a word to the newest stage unless some stage already contains it,
+     * and adds a stage when the newest one is half full.
+     *
+     * @param word The word to insert. Case is ignored.
+     *
+     * @return true if the filter considered the word new.
+     */
+    bool insert(std::string_view word) {
+        return insertHash(HashWord(word));
+    }
+
+    /**
+     * The function `insertHash` is `insert` for a word whose `HashWord` value is already known.
+     */
+    bool insertHash(uint64_t hash) {
+        int count = stageCount();
+        for (int s = 0; s < count - 1; ++s) {
+            if (state->stages[s].filter->containsHash(hash)) {
+                return false;
+            }
+        }
+
+        Stage& stage = state->stages[count - 1];
+        BloomFilter& filter = *stage.filter;
+        uint64_t newBits = 0;
+        for (int i = 0; i < filter.hashes(); ++i) {
+            if (!filter.testAndSet(ProbePosition(hash, i, filter.bits()))) {
+                newBits++;
+            }
+        }
+        if (newBits == 0) {
+            return false;
+        }
+
+        uint64_t setBits = stage.setBits.fetch_add(newBits, std::memory_order_relaxed) + newBits;
+        if (setBits * 2 >= filter.bits()) {
+            Grow(count);
+        }
+        return true;
+    }
+
+private:
+    struct Stage {
+        std::unique_ptr<BloomFilter> filter;
+        std::atomic<uint64_t> setBits{0};
+    };
+
+    /* kept on the heap so the filter can be moved while the stages stay put */
+    struct State {
+        FilterParams first;
+        Stage stages[MAX_STAGES];
+        std::atomic<int> count{0};
+        std::mutex growLock;
+    };
+
+    /**
+     * The function StageParams gives stage `stage` twice the capacity of the one before and one more
+     * probe: m_s = m_0 2^s (k_0 + s) / k_0 and k_s = k_0 + s.
+     */
+    static FilterParams StageParams(FilterParams first, int stage) {
+        FilterParams params;
+        params.hashes = first.hashes + stage;
+        double bits = std::ldexp(static_cast<double>(first.bits), stage) * params.hashes / first.hashes;
+        params.bits = static_cast<uint32_t>(std::min(bits, 4294967295.0));
+        return params;
+    }
+
+    /* adds stage `count` unless another thread already has; the last stage keeps filling at the limit */
+    void Grow(int count) {
+        std::lock_guard<std::mutex> guard(state->growLock);
+        if (state->count.load(std::memory_order_relaxed) != count || count == MAX_STAGES) {
+            return;
+        }
+        state->stages[count].filter.reset(new BloomFilter(StageParams(state->first, count)));
+        state->count.store(count + 1, std::memory_order_release);
+    }
+
+    template <typename Func>
+    void ForEachStage(Func&& func) const {
+        int count = stageCount();
+        for (int s = 0; s < count; ++s) {
+            func(*state->stages[s].filter);
+        }
+    }
+
+    std::unique_ptr<State> state;
+};
+
+#endif
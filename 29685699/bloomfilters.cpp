@@ -1,62 +1,17 @@
 #include <iostream>
-#include <fstream>
 #include <string>
+#include <string_view>
 #include <bitset>
 #include <chrono>
-#include <cctype>
 
-#define BLOOM_FILTER_SIZE 1000000
+#include "bloomhash.h"
+#include "wordreader.h"
 
 std::bitset<BLOOM_FILTER_SIZE> bloom_filter;
 
 /**
- * The function `hash1` calculates a hash value for a given string using the djb2 algorithm.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. 
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash1(const std::string& str) {
-    unsigned int hash = 5381;
-    for (char c : str) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-
-/**
- * The function `hash2` calculates a hash value for a given string using a bitwise operation and
- * returns the hash modulo a constant value `BLOOM_FILTER_SIZE`.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. 
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash2(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 6) + (hash << 16) - hash;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-
-/**
- * The hash3 function takes a string as input and returns an unsigned integer hash value.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. 
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash3(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 7) + (hash << 15) - hash;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-/**
- * The function reads words from a file, converts them to lowercase, checks if they are already in a
- * bloom filter, and inserts them if they are not.
+ * The function maps a file into memory, walks its words in place, checks if they are already in a
+ * bloom filter, and inserts them if they are not. Case is folded by the hash functions.
  * 
  * @param filename The `filename` parameter is a `std::string` that represents the name of the file
  * from which we want to read words.
@@ -66,31 +21,31 @@ unsigned int hash3(const std::string& str) {
 
 int ReadAndInsert(const std::string& filename) {
     int uniqueWordsCount = 0;
-    std::ifstream file(filename);
-    std::string word;
+    MappedFile file(filename);
 
     if (!file.is_open()) {
         std::cerr << "Failed to open file" << std::endl;
         exit(1);
     }
 
-    while (file >> word) {
-        for (char& c : word) {
-            c = std::tolower(c);
-        }
-        
-        if (bloom_filter[hash1(word)] &&
-            bloom_filter[hash2(word)] &&
-            bloom_filter[hash3(word)]) {
-            continue;
+    ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        uint64_t hash = HashWord(word);
+        bool seen = true;
+
+        for (int i = 0; i < HASH_COUNT; ++i) {
+            unsigned int pos = ProbePosition(hash, i);
+            if (!bloom_filter[pos]) {
+                bloom_filter[pos] = 1;
+                seen = false;
+            }
         }
 
-        bloom_filter[hash1(word)] = 1;
-        bloom_filter[hash2(word)] = 1;
-        bloom_filter[hash3(word)] = 1;
+        if (seen) {
+            return;
+        }
         
         uniqueWordsCount++;
-    }
+    });
 
     return uniqueWordsCount;
 }
@@ -1,65 +1,17 @@
 #include <iostream>
-#include <fstream>
 #include <string>
+#include <string_view>
 #include <bitset>
 #include <chrono>
-#include <cctype>
 
-#define BLOOM_FILTER_SIZE 1000000
+#include "bloomhash.h"
+#include "wordreader.h"
 
 std::bitset<BLOOM_FILTER_SIZE> bloom_filter;
 
 /**
- * The function `hash1` calculates a hash value for a given string using the djb2 algorithm.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. It represents the
- * string for which we want to calculate the hash value.
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash1(const std::string& str) {
-    unsigned int hash = 5381;
-    for (char c : str) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-
-/**
- * The function `hash2` calculates a hash value for a given string using a bitwise operation and
- * returns the hash modulo a constant value `BLOOM_FILTER_SIZE`.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. It represents the
- * string for which we want to calculate the hash value.
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash2(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 6) + (hash << 16) - hash;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-
-/**
- * The hash3 function takes a string as input and returns an unsigned integer hash value.
- * 
- * @param str The parameter `str` is a constant reference to a `std::string` object. It represents the
- * string for which we want to calculate the hash value.
- * 
- * @return an unsigned integer, which is the hash value of the input string.
- */
-unsigned int hash3(const std::string& str) {
-    unsigned int hash = 0;
-    for (char c : str) {
-        hash = c + (hash << 7) + (hash << 15) - hash;
-    }
-    return hash % BLOOM_FILTER_SIZE;
-}
-/**
- * The function reads words from a file, converts them to lowercase, checks if they are already in a
- * bloom filter, and inserts them if they are not.
+ * The function maps a file into memory, walks its words in place, checks if they are already in a
+ * bloom filter, and inserts them if they are not. Case is folded by the hash functions.
  * 
  * @param filename The `filename` parameter is a `std::string` that represents the name of the file
  * from which we want to read words.
@@ -69,48 +21,46 @@ unsigned int hash3(const std::string& str) {
 
 int ReadFromFileAndInsert(const std::string& filename) {
     int uniqueWordsCount = 0;
-    std::ifstream file(filename);
-    std::string word;
+    MappedFile file(filename);
 
     if (!file.is_open()) {
         std::cerr << "Failed to open file" << std::endl;
         exit(1);
     }
 
-/* loop that reads words from a file, converts them to lowercase,
+/* loop that walks the words of the file,
 checks if they are already in a Bloom filter, and inserts them if they are not. */
-    while (file >> word) {
-        for (char& c : word) {
-            c = std::tolower(c);
-        }
-        
-        if (bloom_filter[hash1(word)] &&
-            bloom_filter[hash2(word)] &&
-            bloom_filter[hash3(word)]) {
-            continue;
+    ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        uint64_t hash = HashWord(word);
+        bool seen = true;
+
+        for (int i = 0; i < HASH_COUNT; ++i) {
+            unsigned int pos = ProbePosition(hash, i);
+            if (!bloom_filter[pos]) {
+                bloom_filter[pos] = 1;
+                seen = false;
+            }
         }
 
-        bloom_filter[hash1(word)] = 1;
-        bloom_filter[hash2(word)] = 1;
-        bloom_filter[hash3(word)] = 1;
+        if (seen) {
+            return;
+        }
         
         uniqueWordsCount++;
-    }
+    });
 
     return uniqueWordsCount;
 }
 /**
- * The function QueryBloomFilter reads words from a query file, converts them to lowercase, and checks
+ * The function QueryBloomFilter maps a query file into memory, walks its words in place, and checks
  * if they exist in a Bloom filter, counting the number of false positives.
  * 
  * @param query_filename The query_filename parameter is a string that represents the name of the file
  * containing the queries.
  */
 void QueryBloomFilter(const std::string& query_filename) {
-    std::ifstream query_file(query_filename);
-    std::string query_word;
+    MappedFile query_file(query_filename);
     int count_false_positive = 0;
-    int dummy;
 
     if (!query_file.is_open()) {
         std::cerr << "Failed to open query file" << std::endl;
@@ -118,14 +68,16 @@ void QueryBloomFilter(const std::string& query_filename) {
     }
 
 /* reads words from a query file and checking if they exist in a Bloom filter. */
-    while (query_file >> query_word >> dummy) { // Read word and a dummy integer
-        for (char& c : query_word) {
-            c = std::tolower(c);
+    ForEachQueryWord(query_file.data(), query_file.data() + query_file.size(), [&](std::string_view query_word) { // Count column is skipped
+
+        uint64_t hash = HashWord(query_word);
+        bool present = true;
+
+        for (int i = 0; i < HASH_COUNT && present; ++i) {
+            present = bloom_filter[ProbePosition(hash, i)];
         }
 
-        if (bloom_filter[hash1(query_word)] &&
-            bloom_filter[hash2(query_word)] &&
-            bloom_filter[hash3(query_word)]) {
+        if (present) {
             // Uncomment to show the words that 'probably exist'
             // std::cout << query_word << " probably exists in the text.\n";
         } else {
@@ -133,7 +85,7 @@ void QueryBloomFilter(const std::string& query_filename) {
             // std::cout << query_word << " does not exist in the text.\n";
             count_false_positive++;
         }
-    }
+    });
 
     std::cout << "Number of false positives: " << count_false_positive << std::endl;
 }
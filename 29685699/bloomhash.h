@@ -0,0 +1,100 @@
+#ifndef BLOOMHASH_H
+#define BLOOMHASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "wordreader.h"
+
+#define BLOOM_FILTER_SIZE 1000000
+#define HASH_COUNT 3
+/* the most probes `--hashes` accepts */
+#define MAX_HASH_COUNT 64
+#define HASH_SEED 0xa0761d6478bd642full
+
+/**
+ * The function Mum multiplies two 64-bit values into 128 bits and folds the halves together, which
+ * mixes every input bit into every output bit for the cost of one multiply.
+ */
+inline uint64_t Mum(uint64_t a, uint64_t b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+/**
+ * The function LowerAscii8 converts every ASCII capital letter among the eight bytes of `x` to
+ * lowercase at once and leaves all other bytes, including non-ASCII ones, alone.
+ */
+inline uint64_t LowerAscii8(uint64_t x) {
+    const uint64_t ones = 0x0101010101010101ull;
+    uint64_t heptets = x & (0x7f * ones);
+    uint64_t aboveZ = heptets + (0x7f - 'Z') * ones;
+    uint64_t atLeastA = heptets + (0x80 - 'A') * ones;
+    uint64_t isUpper = ~x & (atLeastA ^ aboveZ) & (0x80 * ones);
+    return x | (isUpper >> 2);
+}
+
+/**
+ * The function HashWord computes one 64-bit hash of a word in a single pass, reading it eight bytes at
+ * a time. Letters are folded to lowercase as they are read, so the word can be hashed straight out of
+ * the file. Every probe position is derived from this one value, so the cost per word does not grow
+ * with the number of probes.
+ *
+ * @param word The word to hash.
+ *
+ * @return a 64-bit hash of the lowercased word.
+ */
+inline uint64_t HashWord(std::string_view word) {
+    const uint64_t k1 = 0xe7037ed1a0b428dbull;
+    const uint64_t k2 = 0x8ebc6af09c88c6e3ull;
+    const char* p = word.data();
+    size_t n = word.size();
+    uint64_t hash = HASH_SEED ^ n;
+    uint64_t chunk;
+
+    while (n >= 8) {
+        std::memcpy(&chunk, p, 8);
+        hash = Mum(hash ^ LowerAscii8(chunk), k1);
+        p += 8;
+        n -= 8;
+    }
+
+    chunk = 0;
+    std::memcpy(&chunk, p, n);
+    hash = Mum(hash ^ LowerAscii8(chunk) ^ k2, k1);
+
+    /* final avalanche (MurmurHash3 fmix64) so the low and high halves are both usable */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * The function FastRange maps a 32-bit value uniformly onto [0, range) with a multiply and a shift
+ * instead of a division.
+ */
+inline uint32_t FastRange(uint32_t x, uint32_t range) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(x) * range) >> 32);
+}
+
+/**
+ * The function ProbePosition gives the i-th bit position of a word in a filter of `range` bits, using
+ * the Kirsch-Mitzenmacher construction h1 + i * h2 on the two halves of the word hash.
+ *
+ * @param hash The value returned by `HashWord`.
+ * @param i The probe number, in the range [0, HASH_COUNT).
+ * @param range The number of bits in the filter.
+ *
+ * @return a bit position in the range [0, range).
+ */
+inline uint32_t ProbePosition(uint64_t hash, int i, uint32_t range = BLOOM_FILTER_SIZE) {
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32);
+    return FastRange(h1 + i * h2, range);
+}
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef CHUNKEDREADER_H
+#define CHUNKEDREADER_H
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+#include "wordreader.h"
+
+#define STEAL_CHUNK_SIZE (256 * 1024)
+#define MERGE_SLICE_WORDS 4096
+
+/* Work done by one thread while tokenizing its byte range of a file. */
+struct ThreadStats {
+    long long words = 0;
+    size_t bytes = 0;
+    long long microseconds = 0;
+    int tasks = 0;
+    int stolen = 0;
+};
+
+/* A byte range of one file, the unit of work handed out by `StealingForEachWord`. */
+struct ChunkTask {
+    int file;
+    size_t begin;
+    size_t end;
+};
+
+/**
+ * The function SplitIntoChunks divides a buffer into `chunkCount` byte ranges of roughly equal size.
+ * Every boundary is moved forward to the next whitespace character, so no word is split between two
+ * ranges and tokenizing every range gives exactly the words `operator>>` would give for the whole
+ * buffer.
+ *
+ * @param data The buffer to split.
+ * @param chunkCount The number of ranges wanted, usually the number of threads.
+ *
+ * @return a vector of [begin, end) offsets into `data`. Ranges may be empty when the buffer is small.
+ */
+inline std::vector<std::pair<size_t, size_t>> SplitIntoChunks(std::string_view data, int chunkCount) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    size_t begin = 0;
+
+    for (int i = 1; i <= chunkCount; ++i) {
+        size_t end = (i == chunkCount) ? data.size() : data.size() / chunkCount * i;
+        if (end < begin) {
+            end = begin;
+        }
+        while (end < data.size() && !IsSpace(data[end])) {
+            end++;
+        }
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+
+    return chunks;
+}
+
+/**
+ * The function SplitIntoLineChunks divides a buffer into `chunkCount` byte ranges of roughly equal
+ * size with every boundary moved forward to just after a newline. It is used for files whose lines
+ * belong together, such as the `word count` pairs of a query file.
+ *
+ * @param data The buffer to split.
+ * @param chunkCount The number of ranges wanted, usually the number of threads.
+ *
+ * @return a vector of [begin, end) offsets into `data`. Ranges may be empty when the buffer is small.
+ */
+inline std::vector<std::pair<size_t, size_t>> SplitIntoLineChunks(std::string_view data, int chunkCount) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    size_t begin = 0;
+
+    for (int i = 1; i <= chunkCount; ++i) {
+        size_t end = (i == chunkCount) ? data.size() : data.size() / chunkCount * i;
+        if (end < begin) {
+            end = begin;
+        }
+        if (end > 0 && end < data.size() && data[end - 1] != '\n') {
+            size_t newline = data.find('\n', end);
+            end = (newline == std::string_view::npos) ? data.size() : newline + 1;
+        }
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+
+    return chunks;
+}
+
+/**
+ * The function ParallelForEachWord splits a buffer into one whitespace-aligned range per OpenMP
+ * thread and has every thread tokenize and lowercase its own range, so a single file is processed by
+ * all cores instead of one. Words are passed in their original case.
+ *
+ * @param data The mapped contents of the file.
+ * @param func A callable taking `(int thread, std::string_view word)`. It is called concurrently from
+ * every thread, so anything it writes to must be thread-safe or indexed by `thread`.
+ *
+ * @return one `ThreadStats` entry per range, recording the words, bytes and time of that thread.
+ */
+template <typename Func>
+std::vector<ThreadStats> ParallelForEachWord(std::string_view data, Func&& func) {
+    std::vector<std::pair<size_t, size_t>> chunks = SplitIntoChunks(data, omp_get_max_threads());
+    std::vector<ThreadStats> stats(chunks.size());
+
+    #pragma omp parallel for schedule(static, 1)
+    for (int i = 0; i < static_cast<int>(chunks.size()); ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        stats[i].words = ForEachWord(data.data() + chunks[i].first, data.data() + chunks[i].second,
+                                     [&](std::string_view word) { func(i, word); });
+        auto end = std::chrono::high_resolution_clock::now();
+
+        stats[i].bytes = chunks[i].second - chunks[i].first;
+        stats[i].microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+
+    return stats;
+}
+
+/**
+ * The function PrintThreadStats prints the words, bytes and throughput of every thread, so the scaling
+ * of the chunked mode can be checked against the thread count.
+ *
+ * @param stats The per-thread statistics returned by `ParallelForEachWord`.
+ */
+inline void PrintThreadStats(const std::vector<ThreadStats>& stats) {
+    for (size_t i = 0; i < stats.size(); ++i) {
+        double megabytes = stats[i].bytes / 1e6;
+        double seconds = stats[i].microseconds / 1e6;
+        std::cout << "  Thread " << i << ": " << stats[i].words << " words, " << megabytes << " MB in "
+                  << stats[i].microseconds / 1000.0 << " milliseconds ("
+                  << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s)";
+        if (stats[i].tasks > 0) {
+            std::cout << ", " << stats[i].tasks << " chunks, " << stats[i].stolen << " stolen";
+        }
+        std::cout << ".\n";
+    }
+}
+
+/**
+ * The function StealingForEachWord tokenizes several files on all threads with work stealing. Every
+ * file is cut into whitespace-aligned chunks of about `chunkSize` bytes. Each thread starts with the
+ * chunks of the files a static one-file-per-thread schedule would have given it (file i to thread
+ * i % threads), in a deque of its own, and works through them from the front. A thread whose deque is
+ * empty takes a chunk from the back of another thread's deque, so a thread holding a large file is
+ * helped by those that finished small ones, and the work ends when every deque is empty.
+ *
+ * @param files The mapped contents of the files.
+ * @param chunkSize The target size of a chunk in bytes.
+ * @param func A callable taking `(int thread, int file, std::string_view word)`. It is called
+ * concurrently from every thread, so anything it writes to must be thread-safe or indexed by `thread`.
+ *
+ * @return one `ThreadStats` entry per thread: words, bytes, chunks processed, chunks stolen, and the
+ * time from the start until the thread found no work left.
+ */
+template <typename Func>
+std::vector<ThreadStats> StealingForEachWord(const std::vector<std::string_view>& files, size_t chunkSize, Func&& func) {
+    int threads = omp_get_max_threads();
+    std::vector<std::deque<ChunkTask>> deques(threads);
+    std::vector<omp_lock_t> locks(threads);
+    std::vector<ThreadStats> stats(threads);
+
+    for (int f = 0; f < static_cast<int>(files.size()); ++f) {
+        int chunkCount = std::max<size_t>(1, (files[f].size() + chunkSize - 1) / chunkSize);
+        for (const auto& chunk : SplitIntoChunks(files[f], chunkCount)) {
+            if (chunk.second > chunk.first) {
+                deques[f % threads].push_back(ChunkTask{f, chunk.first, chunk.second});
+            }
+        }
+    }
+    for (auto& lock : locks) {
+        omp_init_lock(&lock);
+    }
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        auto start = std::chrono::high_resolution_clock::now();
+
+        while (true) {
+            ChunkTask task;
+            bool found = false;
+
+            omp_set_lock(&locks[t]);
+            if (!deques[t].empty()) {
+                task = deques[t].front();
+                deques[t].pop_front();
+                found = true;
+            }
+            omp_unset_lock(&locks[t]);
+
+            for (int v = 1; v < threads && !found; ++v) {
+                int victim = (t + v) % threads;
+                omp_set_lock(&locks[victim]);
+                if (!deques[victim].empty()) {
+                    task = deques[victim].back();
+                    deques[victim].pop_back();
+                    found = true;
+                    stats[t].stolen++;
+                }
+                omp_unset_lock(&locks[victim]);
+            }
+            if (!found) {
+                break;
+            }
+
+            const char* data = files[task.file].data();
+            stats[t].words += ForEachWord(data + task.begin, data + task.end,
+                                          [&](std::string_view word) { func(t, task.file, word); });
+            stats[t].bytes += task.end - task.begin;
+            stats[t].tasks++;
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        stats[t].microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+
+    for (auto& lock : locks) {
+        omp_destroy_lock(&lock);
+    }
+    return stats;
+}
+
+/**
+ * The function PrintLoadImbalance prints how unevenly the threads were loaded: the busiest thread's
+ * time as a percentage above the mean thread time, (max / mean - 1) * 100. 0% means every thread
+ * worked for the same time; with a static schedule the wall-clock time is set by the busiest thread,
+ * so the percentage is also how much longer the run took than a perfectly balanced one.
+ *
+ * @param stats The per-thread statistics; only `microseconds` is used.
+ */
+inline void PrintLoadImbalance(const std::vector<ThreadStats>& stats) {
+    long long maxTime = 0;
+    double meanTime = 0;
+    for (const auto& stat : stats) {
+        maxTime = std::max(maxTime, stat.microseconds);
+        meanTime += stat.microseconds;
+    }
+    meanTime /= std::max<size_t>(1, stats.size());
+
+    std::cout << "Load imbalance: " << (meanTime > 0 ? (maxTime / meanTime - 1) * 100 : 0.0) << "% (busiest thread "
+              << maxTime / 1000.0 << " milliseconds, mean " << meanTime / 1000.0 << " milliseconds over " << stats.size() << " threads).\n";
+}
+
+/**
+ * The function TreeMerge ORs a list of filters of the same size into the first one with a binary tree
+ * reduction: in round r every filter at an index that is a multiple of 2^(r+1) absorbs the one 2^r
+ * after it, so n filters are merged in ceil(log2 n) rounds. Within a round, every pair is also cut into
+ * slices of `MERGE_SLICE_WORDS` words, and all (pair, slice) tasks are shared by the threads, so the
+ * last rounds, with few pairs left, still use every core. The slices are ORed with `OrWords`.
+ *
+ * @param filters The filters to merge; the result is left in `*filters[0]`. Nothing may insert into
+ * any of them while the merge runs.
+ */
+template <typename Filter>
+void TreeMerge(const std::vector<Filter*>& filters) {
+    int count = static_cast<int>(filters.size());
+    if (count < 2) {
+        return;
+    }
+    size_t words = filters[0]->wordCount();
+    int slices = static_cast<int>(std::max<size_t>(1, (words + MERGE_SLICE_WORDS - 1) / MERGE_SLICE_WORDS));
+
+    for (int stride = 1; stride < count; stride *= 2) {
+        int pairs = (count - stride + 2 * stride - 1) / (2 * stride);
+
+        #pragma omp parallel for collapse(2) schedule(static)
+        for (int p = 0; p < pairs; ++p) {
+            for (int s = 0; s < slices; ++s) {
+                int target = p * 2 * stride;
+                size_t begin = words * s / slices;
+                size_t end = words * (s + 1) / slices;
+                filters[target]->merge(*filters[target + stride], begin, end);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CMDLINE_H
+#define CMDLINE_H
+
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+/**
+ * The function ParseUnsigned reads a whole command line value as a decimal integer, so that values the
+ * programs would otherwise take apart silently, such as "abc", "-1", "12x" or one that does not fit
+ * the target type, are turned away instead.
+ *
+ * @param value The text after the `=` of an option.
+ * @param min The smallest value accepted.
+ * @param max The largest value accepted.
+ * @param out Receives the value; left unchanged when it is rejected.
+ *
+ * @return true if `value` is a number in [min, max] with nothing after it.
+ */
+inline bool ParseUnsigned(const std::string& value, unsigned long long min, unsigned long long max, unsigned long long& out) {
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long number = std::strtoull(value.c_str(), &end, 10);
+    if (errno == ERANGE || *end != '\0' || number < min || number > max) {
+        return false;
+    }
+    out = number;
+    return true;
+}
+
+/**
+ * The function ParseReal reads a whole command line value as a finite floating point number.
+ *
+ * @param value The text after the `=` of an option.
+ * @param out Receives the value; left unchanged when it is rejected.
+ *
+ * @return true if `value` is a finite number with nothing after it.
+ */
+inline bool ParseReal(const std::string& value, double& out) {
+    if (value.empty() || std::isspace(static_cast<unsigned char>(value[0]))) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    double number = std::strtod(value.c_str(), &end);
+    if (errno == ERANGE || *end != '\0' || !std::isfinite(number)) {
+        return false;
+    }
+    out = number;
+    return true;
+}
+
+#endif
@@ -0,0 +1,481 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "cmdline.h"
+
+#define VOCABULARY_SIZE 100000
+#define ZIPF_EXPONENT 1.0
+#define WORDS_PER_LINE 12
+#define WRITE_BUFFER_SIZE (1 << 20)
+#define OUTPUT_DIR "corpus"
+
+/* Settings taken from the command line. */
+struct Options {
+    std::vector<std::string> filenames = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
+    unsigned long long bytesPerFile = 1000000;
+    uint32_t vocabulary = VOCABULARY_SIZE;
+    double exponent = ZIPF_EXPONENT;
+    long long queries = 100000;
+    double presentRatio = 0.9;
+    std::string queryFile = "query.txt";
+    std::string outDir = OUTPUT_DIR;
+    uint64_t seed = 1;
+};
+
+/**
+ * A small, fast pseudo random generator (xoshiro256**) seeded through splitmix64, so that every file
+ * can get its own independent stream from one seed.
+ */
+class Random {
+public:
+    explicit Random(uint64_t seed) {
+        for (uint64_t& word : state) {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = Rotate(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = Rotate(state[3], 45);
+        return result;
+    }
+
+    /* uniform in [0, range) */
+    uint32_t below(uint32_t range) {
+        return static_cast<uint32_t>(((next() >> 32) * range) >> 32);
+    }
+
+    /* uniform in [0, 1) */
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    static uint64_t Rotate(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t state[4];
+};
+
+/**
+ * A Zipf distribution over ranks [0, n): rank r is drawn with probability proportional to
+ * 1 / (r + 1)^s. Sampling uses Vose's alias method, so drawing a word costs one random number and two
+ * table reads whatever the vocabulary size.
+ */
+class ZipfSampler {
+public:
+    ZipfSampler(uint32_t n, double exponent) : probability(n), alias(n) {
+        std::vector<double> scaled(n);
+        double total = 0;
+        for (uint32_t r = 0; r < n; ++r) {
+            scaled[r] = std::pow(r + 1.0, -exponent);
+            total += scaled[r];
+        }
+
+        std::vector<uint32_t> small;
+        std::vector<uint32_t> large;
+        for (uint32_t r = 0; r < n; ++r) {
+            scaled[r] *= n / total;
+            (scaled[r] < 1.0 ? small : large).push_back(r);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back();
+            uint32_t l = large.back();
+            small.pop_back();
+            probability[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        for (uint32_t r : large) {
+            probability[r] = 1.0;
+            alias[r] = r;
+        }
+        for (uint32_t r : small) {
+            probability[r] = 1.0;
+            alias[r] = r;
+        }
+    }
+
+    uint32_t sample(Random& random) const {
+        uint32_t r = random.below(probability.size());
+        return random.uniform() < probability[r] ? r : alias[r];
+    }
+
+private:
+    std::vector<double> probability;
+    std::vector<uint32_t> alias;
+};
+
+/**
+ * The function AppendWord writes the word of a rank: rank 0 is "a", 25 is "z", 26 is "aa" and so on
+ * (bijective base 26). Frequent ranks get short words, as in real text, and every rank has its own
+ * word, so ranks at or above the vocabulary size give words that never occur in the corpus.
+ *
+ * @param rank The rank of the word.
+ * @param out Pointer to at least 8 writable bytes.
+ *
+ * @return the number of bytes written.
+ */
+int AppendWord(uint64_t rank, char* out) {
+    char reversed[16];
+    int length = 0;
+    uint64_t n = rank + 1;
+    while (n > 0) {
+        n--;
+        reversed[length++] = 'a' + n % 26;
+        n /= 26;
+    }
+    for (int i = 0; i < length; ++i) {
+        out[i] = reversed[length - 1 - i];
+    }
+    return length;
+}
+
+/**
+ * A buffered writer over a file descriptor, so that a corpus of many gigabytes is written in large
+ * blocks without going through an iostream per word. The file must not exist yet (`O_EXCL`), so an
+ * existing corpus or the sample books are never overwritten.
+ */
+class BufferedWriter {
+public:
+    explicit BufferedWriter(const std::string& filename)
+        : fd(open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644)), buffer(WRITE_BUFFER_SIZE) {}
+
+    ~BufferedWriter() {
+        flush();
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool is_open() const { return fd >= 0; }
+    bool good() const { return ok; }
+    unsigned long long written() const { return total + used; }
+
+    /* returns room for at least `bytes` bytes; call `commit` with the number actually used */
+    char* reserve(size_t bytes) {
+        if (used + bytes > buffer.size()) {
+            flush();
+        }
+        return buffer.data() + used;
+    }
+    void commit(size_t bytes) { used += bytes; }
+
+    void flush() {
+        size_t done = 0;
+        while (done < used && ok) {
+            ssize_t n = write(fd, buffer.data() + done, used - done);
+            if (n < 0) {
+                ok = false;
+            } else {
+                done += n;
+            }
+        }
+        total += used;
+        used = 0;
+    }
+
+private:
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+    unsigned long long total = 0;
+    bool ok = true;
+};
+
+/**
+ * The function GenerateFile writes words drawn from the Zipf distribution to one file until it holds
+ * `bytes` bytes, `WORDS_PER_LINE` words per line, and marks every rank it used in `used`.
+ *
+ * @param filename The file to write.
+ * @param bytes The size to reach; the file ends at the first line break after it.
+ * @param sampler The word distribution.
+ * @param seed The seed of this file's random stream.
+ * @param used One bit per rank, set (atomically, files are generated in parallel) for every rank written.
+ *
+ * @return the number of words written.
+ */
+long long GenerateFile(const std::string& filename, unsigned long long bytes, const ZipfSampler& sampler, uint64_t seed, std::vector<std::atomic<uint64_t>>& used) {
+    BufferedWriter out(filename);
+    Random random(seed);
+    long long wordCount = 0;
+
+    if (!out.is_open()) {
+        std::cerr << "Failed to create " << filename << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    while (out.written() < bytes) {
+        for (int i = 0; i < WORDS_PER_LINE; ++i) {
+            uint32_t rank = sampler.sample(random);
+            std::atomic<uint64_t>& bits = used[rank >> 6];
+            uint64_t mask = uint64_t(1) << (rank & 63);
+            if (!(bits.load(std::memory_order_relaxed) & mask)) {
+                bits.fetch_or(mask, std::memory_order_relaxed);
+            }
+
+            char* p = out.reserve(16);
+            int length = AppendWord(rank, p);
+            p[length] = i + 1 < WORDS_PER_LINE ? ' ' : '\n';
+            out.commit(length + 1);
+            wordCount++;
+        }
+    }
+
+    out.flush();
+    if (!out.good()) {
+        std::cerr << "Failed to write " << filename << std::endl;
+        exit(1);
+    }
+    return wordCount;
+}
+
+/**
+ * The function GenerateQueries writes a query file in the `word count` format of `query.txt`: a
+ * fraction `presentRatio` of the queries are words that occur in the corpus (count 1), chosen
+ * uniformly among the distinct words, and the rest are words that occur nowhere (count 0).
+ *
+ * @param options The settings from the command line.
+ * @param used One bit per rank, set for every rank in the corpus.
+ *
+ * @return the number of distinct words in the corpus.
+ */
+uint32_t GenerateQueries(const Options& options, const std::vector<std::atomic<uint64_t>>& used) {
+    std::vector<uint32_t> present;
+    for (uint32_t rank = 0; rank < options.vocabulary; ++rank) {
+        if ((used[rank >> 6].load(std::memory_order_relaxed) >> (rank & 63)) & 1) {
+            present.push_back(rank);
+        }
+    }
+
+    BufferedWriter out(options.queryFile);
+    Random random(options.seed ^ 0x5175657279ull);
+    if (!out.is_open()) {
+        std::cerr << "Failed to create " << options.queryFile << ": " << std::strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    for (long long q = 0; q < options.queries; ++q) {
+        bool isPresent = !present.empty() && random.uniform() < options.presentRatio;
+        uint64_t rank = isPresent ? present[random.below(present.size())]
+                                  : options.vocabulary + static_cast<uint64_t>(random.below(0xffffffffu));
+        char* p = out.reserve(32);
+        int length = AppendWord(rank, p);
+        p[length] = ' ';
+        p[length + 1] = isPresent ? '1' : '0';
+        p[length + 2] = '\n';
+        out.commit(length + 3);
+    }
+
+    out.flush();
+    if (!out.good()) {
+        std::cerr << "Failed to write " << options.queryFile << std::endl;
+        exit(1);
+    }
+    return present.size();
+}
+
+/**
+ * The function ParseSize reads a byte count with an optional K, M or G suffix (powers of 1000).
+ *
+ * @param value The text after `--size=`.
+ * @param out Receives the byte count.
+ *
+ * @return false if `value` is not a positive number followed by at most one known suffix.
+ */
+bool ParseSize(std::string value, unsigned long long& out) {
+    double scale = 1;
+    char suffix = value.empty() ? '\0' : value.back();
+    if (suffix == 'K' || suffix == 'k') {
+        scale = 1e3;
+    } else if (suffix == 'M' || suffix == 'm') {
+        scale = 1e6;
+    } else if (suffix == 'G' || suffix == 'g') {
+        scale = 1e9;
+    }
+    if (scale != 1) {
+        value.pop_back();
+    }
+
+    double number = 0;
+    if (!ParseReal(value, number) || number <= 0 || number * scale >= 1e18) {
+        return false;
+    }
+    out = static_cast<unsigned long long>(number * scale);
+    return true;
+}
+
+/**
+ * The function OutputPath places a file name given on the command line in the output directory,
+ * unless it is an absolute path.
+ */
+std::string OutputPath(const std::string& dir, const std::string& name) {
+    return name.empty() || name[0] == '/' ? name : dir + "/" + name;
+}
+
+/**
+ * The function PrepareOutput creates the output directory if needed and checks that none of the
+ * files to write exists yet, so that nothing is written when any of them would be overwritten.
+ *
+ * @param options The settings from the command line; the file names are turned into paths in
+ * `outDir`.
+ *
+ * @return false, after printing why, if the directory cannot be created or a file already exists.
+ */
+bool PrepareOutput(Options& options) {
+    if (mkdir(options.outDir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Failed to create " << options.outDir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    for (auto& filename : options.filenames) {
+        filename = OutputPath(options.outDir, filename);
+    }
+    options.queryFile = OutputPath(options.outDir, options.queryFile);
+
+    std::vector<std::string> targets = options.filenames;
+    targets.push_back(options.queryFile);
+    for (const auto& target : targets) {
+        struct stat st;
+        if (lstat(target.c_str(), &st) == 0) {
+            std::cerr << "Refusing to overwrite " << target << "; remove it or choose another --out=" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The main function generates a synthetic corpus under the names of the sample books, one thread per
+ * file, and a matching query file. By default it writes MOBY_DICK.txt, LITTLE_WOMEN.txt,
+ * SHAKESPEARE.txt and query.txt into `OUTPUT_DIR`, so every program runs on the output unchanged from
+ * inside that directory. It never overwrites a file: if any of them exists, nothing is written.
+ *
+ * Options: `--out=DIR` (created if missing, default `OUTPUT_DIR`); `--size=BYTES` per file, with
+ * K/M/G suffixes (default 1M); `--files=a.txt,b.txt,...`; `--vocabulary=N` distinct words, 1 to
+ * 2^32 - 1 (default `VOCABULARY_SIZE`); `--zipf=S` exponent (default `ZIPF_EXPONENT`); `--queries=N`
+ * (default 100000); `--present=R` fraction of queries that occur in the corpus (default 0.9);
+ * `--query-file=PATH`; `--seed=N`. File names that are not absolute are taken inside `--out`. The
+ * same options and seed always give the same files.
+ *
+ * @return 0 on success.
+ */
+int main(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        unsigned long long number = 0;
+        if (arg.rfind("--size=", 0) == 0) {
+            if (!ParseSize(arg.substr(7), options.bytesPerFile)) {
+                std::cerr << "Invalid value: " << arg << " (--size takes a positive byte count with an optional K, M or G)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--out=", 0) == 0) {
+            options.outDir = arg.substr(6);
+        } else if (arg.rfind("--files=", 0) == 0) {
+            options.filenames.clear();
+            size_t start = 8;
+            while (start <= arg.size()) {
+                size_t comma = std::min(arg.find(',', start), arg.size());
+                if (comma > start) {
+                    options.filenames.push_back(arg.substr(start, comma - start));
+                }
+                start = comma + 1;
+            }
+        } else if (arg.rfind("--vocabulary=", 0) == 0) {
+            if (!ParseUnsigned(arg.substr(13), 1, UINT32_MAX, number)) {
+                std::cerr << "Invalid value: " << arg << " (--vocabulary takes 1 to 4294967295)" << std::endl;
+                return 1;
+            }
+            options.vocabulary = static_cast<uint32_t>(number);
+        } else if (arg.rfind("--zipf=", 0) == 0) {
+            if (!ParseReal(arg.substr(7), options.exponent) || options.exponent < 0) {
+                std::cerr << "Invalid value: " << arg << " (--zipf takes an exponent of 0 or more)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--queries=", 0) == 0) {
+            if (!ParseUnsigned(arg.substr(10), 0, LLONG_MAX, number)) {
+                std::cerr << "Invalid value: " << arg << " (--queries takes a count)" << std::endl;
+                return 1;
+            }
+            options.queries = static_cast<long long>(number);
+        } else if (arg.rfind("--present=", 0) == 0) {
+            if (!ParseReal(arg.substr(10), options.presentRatio) || options.presentRatio < 0 || options.presentRatio > 1) {
+                std::cerr << "Invalid value: " << arg << " (--present takes a fraction from 0 to 1)" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--query-file=", 0) == 0) {
+            options.queryFile = arg.substr(13);
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            if (!ParseUnsigned(arg.substr(7), 0, ULLONG_MAX, number)) {
+                std::cerr << "Invalid value: " << arg << " (--seed takes a non-negative integer)" << std::endl;
+                return 1;
+            }
+            options.seed = number;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (!PrepareOutput(options)) {
+        return 1;
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ZipfSampler sampler(options.vocabulary, options.exponent);
+    std::vector<std::atomic<uint64_t>> used((options.vocabulary + 63ull) / 64);
+    long long totalWords = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:totalWords)
+    for (int i = 0; i < static_cast<int>(options.filenames.size()); ++i) {
+        auto writeStart = std::chrono::high_resolution_clock::now();
+        long long words = GenerateFile(options.filenames[i], options.bytesPerFile, sampler, options.seed * 1000003 + i, used);
+        totalWords += words;
+        auto writeEnd = std::chrono::high_resolution_clock::now();
+
+        auto writeDuration = std::chrono::duration_cast<std::chrono::microseconds>(writeEnd - writeStart).count();
+        #pragma omp critical
+        {
+            std::cout << "Time taken to write " << options.filenames[i] << ": " << writeDuration << " microseconds, or approximately " << writeDuration / 1000.0 << " milliseconds (" << words << " words).\n";
+        }
+    }
+
+    uint32_t distinct = GenerateQueries(options, used);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+    std::cout << "Total time taken: " << duration << " microseconds, or approximately " << duration / 1000.0 << " milliseconds.\n";
+    std::cout << "Total words written: " << totalWords << ", distinct words: " << distinct << " of " << options.vocabulary << ".\n";
+    std::cout << "Queries written to " << options.queryFile << ": " << options.queries << std::endl;
+    return 0;
+}
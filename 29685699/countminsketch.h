@@ -0,0 +1,134 @@
+#ifndef COUNTMINSKETCH_H
+#define COUNTMINSKETCH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "bloomhash.h"
+
+#define CMS_WIDTH 65536
+#define CMS_DEPTH 4
+/* the most rows `--count-min-depth` accepts */
+#define CMS_MAX_DEPTH 16
+
+/**
+ * A Count-Min sketch (Cormode and Muthukrishnan, 2005) that estimates how often each word occurred,
+ * in `depth` rows of `width` 32-bit counters. A word adds one to one counter per row, at positions
+ * derived from its `HashWord` value as the Bloom filter probes are, and its estimate is the smallest
+ * of those counters. Estimates are never below the true count, and with probability 1 - e^-depth
+ * they are at most e / width times the total number of words above it.
+ *
+ * With conservative update only the counters that hold the current minimum are raised, which keeps
+ * the same guarantee with much smaller overestimates. The counters are plain integers, so each thread
+ * fills a sketch of its own and the sketches are added together with `merge` at the end. Merged
+ * conservative sketches still never underestimate, but they overestimate a little more than one
+ * sketch that saw every word.
+ *
+ * The width must be at least 1 and the depth 1 to `CMS_MAX_DEPTH`; the caller checks both.
+ */
+class CountMinSketch {
+public:
+    explicit CountMinSketch(uint32_t width = CMS_WIDTH, int depth = CMS_DEPTH, bool conservative = false)
+        : columns(width), rows(depth), conservativeUpdate(conservative),
+          counters(static_cast<size_t>(columns) * rows, 0) {}
+
+    uint32_t width() const { return columns; }
+    int depth() const { return rows; }
+    bool conservative() const { return conservativeUpdate; }
+    size_t bytes() const { return counters.size() * sizeof(uint32_t); }
+    size_t counterCount() const { return counters.size(); }
+    /* the number of words added */
+    uint64_t total() const { return added; }
+
+    /**
+     * The function `add` counts one occurrence of a word. Case is ignored, as in the filters.
+     */
+    void add(std::string_view word) {
+        addHash(HashWord(word));
+    }
+
+    /**
+     * The function `addHash` is `add` for a word whose `HashWord` value is already known, so a word
+     * that is inserted into a filter is hashed only once.
+     */
+    void addHash(uint64_t hash) {
+        added++;
+        if (!conservativeUpdate) {
+            for (int i = 0; i < rows; ++i) {
+                counters[Index(hash, i)]++;
+            }
+            return;
+        }
+
+        uint32_t least = UINT32_MAX;
+        for (int i = 0; i < rows; ++i) {
+            least = std::min(least, counters[Index(hash, i)]);
+        }
+        for (int i = 0; i < rows; ++i) {
+            uint32_t& counter = counters[Index(hash, i)];
+            counter = std::max(counter, least + 1);
+        }
+    }
+
+    /**
+     * The function `estimate` returns the estimated number of occurrences of a word.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return at least the true count, and usually exactly it.
+     */
+    uint32_t estimate(std::string_view word) const {
+        return estimateHash(HashWord(word));
+    }
+
+    /**
+     * The function `estimateHash` is `estimate` for a word whose `HashWord` value is already known.
+     */
+    uint32_t estimateHash(uint64_t hash) const {
+        uint32_t least = UINT32_MAX;
+        for (int i = 0; i < rows; ++i) {
+            least = std::min(least, counters[Index(hash, i)]);
+        }
+        return least;
+    }
+
+    /**
+     * The function `merge` adds the counters of `begin` to `end` (counter indices) of a sketch with the
+     * same width and depth, so the caller can split a large merge across threads. The total is added by
+     * the call that covers counter 0.
+     */
+    void merge(const CountMinSketch& other, size_t begin = 0, size_t end = SIZE_MAX) {
+        end = std::min(end, counters.size());
+        for (size_t i = begin; i < end; ++i) {
+            counters[i] += other.counters[i];
+        }
+        if (begin == 0) {
+            added += other.added;
+        }
+    }
+
+    /**
+     * The function `errorBound` returns e / width times the number of words added, the amount an
+     * estimate exceeds the true count by at most, with probability 1 - e^-depth.
+     */
+    double errorBound() const {
+        return std::exp(1.0) / columns * added;
+    }
+
+private:
+    /* the counter of row `i`, with row i's column at h1 + i * h2 as for the filter probes */
+    size_t Index(uint64_t hash, int i) const {
+        return static_cast<size_t>(i) * columns + ProbePosition(hash, i, columns);
+    }
+
+    uint32_t columns;
+    int rows;
+    bool conservativeUpdate;
+    uint64_t added = 0;
+    std::vector<uint32_t> counters;
+};
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef CUCKOOFILTER_H
+#define CUCKOOFILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "bloomfilter.h"
+#include "bloomhash.h"
+
+#define CUCKOO_MAX_KICKS 500
+#define CUCKOO_MAX_LOAD 0.9
+
+/**
+ * A cuckoo filter (Fan et al., 2014) with 16-bit fingerprints in buckets of four, one 64-bit word per
+ * bucket. The low half of the word hash picks the first bucket and the top 16 bits are the
+ * fingerprint; the second bucket is derived from the first and the fingerprint alone, as
+ * (H(fingerprint) - first) mod buckets, so an entry can move between its two buckets without the
+ * word. A lookup reads exactly those two words and compares the four fingerprints of each at once.
+ * With 8 fingerprints compared per lookup the false positive rate is about 8 / 2^16 (0.012%), at 16
+ * bits per slot and about 18 bits per word at the usual 90% load, where a Bloom filter needs 19 bits
+ * per word for the same rate.
+ *
+ * Unlike the Bloom filters, words can be removed. Every insert stores one more copy of the
+ * fingerprint, even if an equal one is already in the word's buckets, so two distinct words that share
+ * both buckets and the fingerprint are stored twice and removing one leaves the other. Callers insert
+ * each distinct word once, as told by its exact set, and remove only words they inserted, so removal
+ * mirrors insertion and the filter never gives a false negative. Inserts and removals take a mutex.
+ * When an insert cannot find room after
+ * `CUCKOO_MAX_KICKS` moves, the last displaced entry is kept aside in a one-entry stash; once that
+ * is taken too, further words are dropped and counted by `dropped()`, since the filter is full.
+ */
+class CuckooFilter {
+public:
+    explicit CuckooFilter(FilterParams params = FilterParams())
+        : bucketCount(static_cast<uint32_t>(std::max<uint64_t>(1, (params.bits + 63ull) / 64))), buckets(bucketCount),
+          state(new State) {}
+
+    /**
+     * The function ParamsFor sizes a filter to hold `expectedWords` words at `CUCKOO_MAX_LOAD`. The
+     * false positive rate is fixed by the fingerprint size, so unlike `OptimalParams` it takes none.
+     */
+    static FilterParams ParamsFor(double expectedWords) {
+        FilterParams params;
+        double buckets = std::ceil(std::max(expectedWords, 1.0) / (4 * CUCKOO_MAX_LOAD));
+        params.bits = static_cast<uint32_t>(std::min(buckets * 64, 4294967232.0));
+        params.hashes = 2;
+        return params;
+    }
+
+    uint64_t bits() const { return uint64_t(bucketCount) * 64; }
+    /* the number of buckets a word may live in, each read with one memory access */
+    int hashes() const { return 2; }
+    size_t bytes() const { return bucketCount * sizeof(uint64_t); }
+    size_t size() const { return state->count; }
+    size_t dropped() const { return state->dropped; }
+
+    /**
+     * The function `contains` checks both buckets of a word, and the stash, for its fingerprint.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is probably in the filter, false if it is definitely not.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word));
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash) const {
+        uint16_t fp = Fingerprint(hash);
+        uint32_t first = FirstBucket(hash);
+        uint32_t second = AlternateBucket(first, fp);
+
+        if (HasFingerprint(buckets[first].load(std::memory_order_relaxed), fp) ||
+            HasFingerprint(buckets[second].load(std::memory_order_relaxed), fp)) {
+            return true;
+        }
+        uint64_t stashed = state->stash.load(std::memory_order_relaxed);
+        return stashed != 0 && (stashed == Pack(first, fp) || stashed == Pack(second, fp));
+    }
+
+    /**
+     * The function `prefetch` starts loading both buckets a later `containsHash(hash)` will read.
+     */
+    void prefetch(uint64_t hash) const {
+        uint32_t first = FirstBucket(hash);
+        __builtin_prefetch(&buckets[first]);
+        __builtin_prefetch(&buckets[AlternateBucket(first, Fingerprint(hash))]);
+    }
+
+    /**
+     * The function `insert` stores one copy of the fingerprint of a word, moving other entries to their
+     * alternate buckets to make room if both are full. A word must be inserted once however often it
+     * occurs, or each copy has to be removed separately.
+     *
+     * @param word The word to insert. Case is ignored.
+     *
+     * @return true if the fingerprint was stored, false if the filter is full and it was dropped.
+     */
+    bool insert(std::string_view word) {
+        return insertHash(HashWord(word));
+    }
+
+    /**
+     * The function `insertHash` is `insert` for a word whose `HashWord` value is already known.
+     */
+    bool insertHash(uint64_t hash) {
+        std::lock_guard<std::mutex> guard(state->mutex);
+        uint16_t fp = Fingerprint(hash);
+        uint32_t index = FirstBucket(hash);
+        if (TryStore(index, fp) || TryStore(AlternateBucket(index, fp), fp)) {
+            state->count++;
+            return true;
+        }
+        if (state->stash.load(std::memory_order_relaxed) != 0) {
+            state->dropped++;
+            return false;
+        }
+
+        if (NextRandom() & 1) {
+            index = AlternateBucket(index, fp);
+        }
+        for (int kick = 0; kick < CUCKOO_MAX_KICKS; ++kick) {
+            unsigned int shift = 16 * (NextRandom() & 3);
+            uint64_t bucket = buckets[index].load(std::memory_order_relaxed);
+            uint16_t evicted = static_cast<uint16_t>(bucket >> shift);
+
+            buckets[index].store((bucket & ~(uint64_t(0xffff) << shift)) | (uint64_t(fp) << shift), std::memory_order_relaxed);
+            fp = evicted;
+            index = AlternateBucket(index, fp);
+            if (TryStore(index, fp)) {
+                state->count++;
+                return true;
+            }
+        }
+        state->stash.store(Pack(index, fp), std::memory_order_relaxed);
+        state->count++;
+        return true;
+    }
+
+    /**
+     * The function `remove` deletes one copy of a word's fingerprint. It must only be called for words
+     * that were inserted, or it may delete the fingerprint of another word.
+     *
+     * @param word The word to remove. Case is ignored.
+     *
+     * @return true if a fingerprint was found and removed.
+     */
+    bool remove(std::string_view word) {
+        return removeHash(HashWord(word));
+    }
+
+    /**
+     * The function `removeHash` is `remove` for a word whose `HashWord` value is already known.
+     */
+    bool removeHash(uint64_t hash) {
+        std::lock_guard<std::mutex> guard(state->mutex);
+        uint16_t fp = Fingerprint(hash);
+        uint32_t first = FirstBucket(hash);
+        uint32_t second = AlternateBucket(first, fp);
+        uint64_t stashed = state->stash.load(std::memory_order_relaxed);
+
+        if (TryRemove(first, fp) || TryRemove(second, fp)) {
+            state->count--;
+            /* the freed slot may be one the stashed entry can use */
+            if (stashed != 0) {
+                uint32_t index = static_cast<uint32_t>(stashed >> 16);
+                uint16_t stashedFp = static_cast<uint16_t>(stashed);
+                if (TryStore(index, stashedFp) || TryStore(AlternateBucket(index, stashedFp), stashedFp)) {
+                    state->stash.store(0, std::memory_order_relaxed);
+                }
+            }
+            return true;
+        }
+        if (stashed != 0 && (stashed == Pack(first, fp) || stashed == Pack(second, fp))) {
+            state->stash.store(0, std::memory_order_relaxed);
+            state->count--;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    /* fingerprint 0 marks an empty slot, so it is mapped to 1 */
+    static uint16_t Fingerprint(uint64_t hash) {
+        uint16_t fp = static_cast<uint16_t>(hash >> 48);
+        return fp ? fp : 1;
+    }
+
+    uint32_t FirstBucket(uint64_t hash) const {
+        return FastRange(static_cast<uint32_t>(hash), bucketCount);
+    }
+
+    /**
+     * The function AlternateBucket maps one bucket of an entry to the other. Both add up to the hash
+     * of the fingerprint modulo the bucket count, so applying it twice gives the first bucket back for
+     * any bucket count, not just powers of two.
+     */
+    uint32_t AlternateBucket(uint32_t index, uint16_t fp) const {
+        uint32_t target = FastRange(static_cast<uint32_t>((fp * 0x9e3779b97f4a7c15ull) >> 32), bucketCount);
+        return target >= index ? target - index : target + bucketCount - index;
+    }
+
+    /* whether any of the four 16-bit slots of `bucket` equals `fp`, by finding a zero slot in their XOR */
+    static bool HasFingerprint(uint64_t bucket, uint16_t fp) {
+        const uint64_t ones = 0x0001000100010001ull;
+        uint64_t x = bucket ^ (ones * fp);
+        return ((x - ones) & ~x & 0x8000800080008000ull) != 0;
+    }
+
+    static uint64_t Pack(uint32_t index, uint16_t fp) {
+        return (uint64_t(index) << 16) | fp;
+    }
+
+    bool TryStore(uint32_t index, uint16_t fp) {
+        uint64_t bucket = buckets[index].load(std::memory_order_relaxed);
+        for (unsigned int shift = 0; shift < 64; shift += 16) {
+            if (((bucket >> shift) & 0xffff) == 0) {
+                buckets[index].store(bucket | (uint64_t(fp) << shift), std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool TryRemove(uint32_t index, uint16_t fp) {
+        uint64_t bucket = buckets[index].load(std::memory_order_relaxed);
+        for (unsigned int shift = 0; shift < 64; shift += 16) {
+            if (((bucket >> shift) & 0xffff) == fp) {
+                buckets[index].store(bucket & ~(uint64_t(0xffff) << shift), std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* xorshift64, for picking which entry to move; only used under the mutex */
+    uint64_t NextRandom() {
+        uint64_t& x = state->random;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    }
+
+    /* everything that is not movable, kept behind a pointer so filters can be stored in a vector */
+    struct State {
+        std::mutex mutex;
+        /* the entry that found no room, as (bucket << 16) | fingerprint, or 0 */
+        std::atomic<uint64_t> stash{0};
+        uint64_t random = 0x2545f4914f6cdd1dull;
+        size_t count = 0;
+        size_t dropped = 0;
+    };
+
+    uint32_t bucketCount;
+    std::vector<std::atomic<uint64_t>> buckets;
+    std::unique_ptr<State> state;
+};
+
+#endif
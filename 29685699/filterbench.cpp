@@ -0,0 +1,248 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+
+#include "bloomfilter.h"
+#include "cuckoofilter.h"
+#include "fusefilter.h"
+#include "wordreader.h"
+#include "wordset.h"
+
+#define REPEATS 5
+#define FILE_COUNT 3
+
+/* The words of one book: every occurrence in order for inserting, whether each is the first of its
+ * word, and the distinct words. */
+struct Book {
+    std::vector<uint64_t> hashes;
+    std::vector<bool> first;
+    WordSet words;
+};
+
+/* Memory, speed and accuracy of one filter type over all books. */
+struct FilterResult {
+    size_t bytes = 0;
+    long long insertMicroseconds = -1;
+    long long lookupMicroseconds = -1;
+    long long positives = 0;
+    long long falsePositives = 0;
+};
+
+/**
+ * The function BenchFilter builds one filter per book from every word occurrence, as `ReadAndInsert`
+ * does, and then looks every query word up in every filter, as `QueryBloomFilters` does. Both steps
+ * run `REPEATS` times on one thread and the fastest run is kept; the filters are rebuilt every time.
+ *
+ * @param books The books, already tokenized and hashed.
+ * @param params The parameters of the filter of each book.
+ * @param queries The `HashWord` values of the query words.
+ * @param queryWords The query words, to tell false positives from real hits.
+ *
+ * @return the total size of the filters, the best times and the positive and false positive counts.
+ */
+template <typename Filter>
+FilterResult BenchFilter(const std::vector<Book>& books, const std::vector<FilterParams>& params, const std::vector<uint64_t>& queries,
+                         const std::vector<std::string_view>& queryWords) {
+    FilterResult result;
+
+    for (int r = 0; r < REPEATS; ++r) {
+        std::vector<Filter> filters;
+        for (const auto& p : params) {
+            filters.emplace_back(p);
+        }
+
+        auto insertStart = std::chrono::high_resolution_clock::now();
+        for (size_t b = 0; b < books.size(); ++b) {
+            for (size_t w = 0; w < books[b].hashes.size(); ++w) {
+                /* the cuckoo filter stores a copy per insert, so it gets each distinct word once */
+                if (!std::is_same_v<Filter, CuckooFilter> || books[b].first[w]) {
+                    filters[b].insertHash(books[b].hashes[w]);
+                }
+            }
+        }
+        auto insertEnd = std::chrono::high_resolution_clock::now();
+
+        long long positives = 0;
+        auto lookupStart = std::chrono::high_resolution_clock::now();
+        for (uint64_t hash : queries) {
+            for (const auto& filter : filters) {
+                positives += filter.containsHash(hash);
+            }
+        }
+        auto lookupEnd = std::chrono::high_resolution_clock::now();
+
+        long long insertMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(insertEnd - insertStart).count();
+        long long lookupMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(lookupEnd - lookupStart).count();
+        if (result.insertMicroseconds < 0 || insertMicroseconds < result.insertMicroseconds) {
+            result.insertMicroseconds = insertMicroseconds;
+        }
+        if (result.lookupMicroseconds < 0 || lookupMicroseconds < result.lookupMicroseconds) {
+            result.lookupMicroseconds = lookupMicroseconds;
+        }
+
+        if (r == 0) {
+            result.positives = positives;
+            for (size_t q = 0; q < queries.size(); ++q) {
+                for (size_t b = 0; b < books.size(); ++b) {
+                    if (filters[b].containsHash(queries[q]) && !books[b].words.containsHash(queries[q], queryWords[q])) {
+                        result.falsePositives++;
+                    }
+                }
+            }
+            for (const auto& filter : filters) {
+                result.bytes += filter.bytes();
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * The function BenchFrozen builds one static binary fuse filter per book from its distinct words, as
+ * `bfparallelQuery --freeze` does, and looks every query word up in every filter. Both steps run
+ * `REPEATS` times and the fastest run is kept; the insert time is the construction time.
+ *
+ * @param books The books, already tokenized and hashed.
+ * @param queries The `HashWord` values of the query words.
+ * @param queryWords The query words, to tell false positives from real hits.
+ *
+ * @return the total size of the filters, the best times and the positive and false positive counts.
+ */
+template <typename Fingerprint>
+FilterResult BenchFrozen(const std::vector<Book>& books, const std::vector<uint64_t>& queries, const std::vector<std::string_view>& queryWords) {
+    std::vector<std::vector<uint64_t>> distinct(books.size());
+    for (size_t b = 0; b < books.size(); ++b) {
+        books[b].words.ForEach([&](uint64_t hash, std::string_view) {
+            distinct[b].push_back(hash);
+        });
+    }
+
+    FilterResult result;
+    for (int r = 0; r < REPEATS; ++r) {
+        std::vector<BinaryFuseFilter<Fingerprint>> filters;
+
+        auto buildStart = std::chrono::high_resolution_clock::now();
+        for (const auto& hashes : distinct) {
+            filters.emplace_back(hashes);
+        }
+        auto buildEnd = std::chrono::high_resolution_clock::now();
+
+        long long positives = 0;
+        auto lookupStart = std::chrono::high_resolution_clock::now();
+        for (uint64_t hash : queries) {
+            for (const auto& filter : filters) {
+                positives += filter.containsHash(hash);
+            }
+        }
+        auto lookupEnd = std::chrono::high_resolution_clock::now();
+
+        long long buildMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(buildEnd - buildStart).count();
+        long long lookupMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(lookupEnd - lookupStart).count();
+        if (result.insertMicroseconds < 0 || buildMicroseconds < result.insertMicroseconds) {
+            result.insertMicroseconds = buildMicroseconds;
+        }
+        if (result.lookupMicroseconds < 0 || lookupMicroseconds < result.lookupMicroseconds) {
+            result.lookupMicroseconds = lookupMicroseconds;
+        }
+
+        if (r == 0) {
+            result.positives = positives;
+            for (size_t q = 0; q < queries.size(); ++q) {
+                for (size_t b = 0; b < books.size(); ++b) {
+                    if (filters[b].containsHash(queries[q]) && !books[b].words.containsHash(queries[q], queryWords[q])) {
+                        result.falsePositives++;
+                    }
+                }
+            }
+            for (const auto& filter : filters) {
+                result.bytes += filter.bytes();
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * The function PrintResult prints one row of the comparison.
+ */
+void PrintResult(const std::string& name, const FilterResult& result, size_t distinctWords, size_t occurrences, size_t lookups) {
+    std::cout << "  " << name << ": " << result.bytes / 1024.0 << " KB (" << result.bytes * 8.0 / distinctWords << " bits per word), insert "
+              << occurrences / (result.insertMicroseconds / 1e6) / 1e6 << " M words/s, lookup "
+              << lookups / (result.lookupMicroseconds / 1e6) / 1e6 << " M lookups/s, "
+              << result.falsePositives << " false positives.\n";
+}
+
+/**
+ * The main function compares the filter types on the sample books and `query.txt`: the classic Bloom
+ * filter at 1% and at the cuckoo filter's false positive rate, the blocked filter at that rate, and
+ * the cuckoo filter. Every filter is sized from the exact vocabulary of its book, and the memory,
+ * insert throughput (every word occurrence), lookup throughput (every query word against every book)
+ * and false positives are printed. The static binary fuse filters, built from the distinct words of
+ * each book, follow with their construction time. Run it from the directory with the books.
+ *
+ * @return 0.
+ */
+int main() {
+    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
+    std::vector<Book> books(FILE_COUNT);
+    std::vector<uint64_t> queries;
+    std::vector<std::string_view> queryWords;
+    size_t distinctWords = 0;
+    size_t occurrences = 0;
+
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        MappedFile file(filenames[i]);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file" << std::endl;
+            exit(1);
+        }
+        ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+            uint64_t hash = HashWord(word);
+            books[i].hashes.push_back(hash);
+            books[i].first.push_back(books[i].words.insertHash(hash, word));
+        });
+        distinctWords += books[i].words.size();
+        occurrences += books[i].hashes.size();
+    }
+
+    MappedFile query_file("query.txt");
+    if (!query_file.is_open()) {
+        std::cerr << "Failed to open query file" << std::endl;
+        exit(1);
+    }
+    ForEachQueryWord(query_file.data(), query_file.data() + query_file.size(), [&](std::string_view word) {
+        queries.push_back(HashWord(word));
+        queryWords.push_back(word);
+    });
+    size_t lookups = queries.size() * FILE_COUNT;
+
+    /* the expected false positive rate of the cuckoo filter, 8 fingerprints of 16 bits compared */
+    const double cuckooRate = 8.0 / 65536;
+    std::vector<FilterParams> bloomOnePercent, bloomMatched, cuckoo;
+    for (const auto& book : books) {
+        bloomOnePercent.push_back(OptimalParams(book.words.size(), 0.01));
+        bloomMatched.push_back(OptimalParams(book.words.size(), cuckooRate));
+        cuckoo.push_back(CuckooFilter::ParamsFor(book.words.size()));
+    }
+
+    std::cout << distinctWords << " distinct words (" << occurrences << " occurrences) in " << FILE_COUNT << " books, "
+              << queries.size() << " queries, best of " << REPEATS << ":\n";
+    PrintResult("classic, 1%", BenchFilter<BloomFilter>(books, bloomOnePercent, queries, queryWords), distinctWords, occurrences, lookups);
+    PrintResult("classic, 0.012%", BenchFilter<BloomFilter>(books, bloomMatched, queries, queryWords), distinctWords, occurrences, lookups);
+    PrintResult("blocked, 0.012%", BenchFilter<BlockedBloomFilter>(books, bloomMatched, queries, queryWords), distinctWords, occurrences, lookups);
+    PrintResult("cuckoo, 16-bit fingerprints", BenchFilter<CuckooFilter>(books, cuckoo, queries, queryWords), distinctWords, occurrences, lookups);
+
+    std::cout << "Static filters, built from the " << distinctWords << " distinct words:\n";
+    for (int bits : {8, 16}) {
+        FilterResult result = bits == 8 ? BenchFrozen<uint8_t>(books, queries, queryWords) : BenchFrozen<uint16_t>(books, queries, queryWords);
+        std::cout << "  binary fuse, " << bits << "-bit: " << result.bytes / 1024.0 << " KB (" << result.bytes * 8.0 / distinctWords
+                  << " bits per word), built in " << result.insertMicroseconds / 1000.0 << " ms ("
+                  << distinctWords / (result.insertMicroseconds / 1e6) / 1e6 << " M words/s), lookup "
+                  << lookups / (result.lookupMicroseconds / 1e6) / 1e6 << " M lookups/s, " << result.falsePositives << " false positives.\n";
+    }
+    return 0;
+}
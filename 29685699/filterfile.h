@@ -0,0 +1,284 @@
+#ifndef FILTERFILE_H
+#define FILTERFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bloomfilter.h"
+#include "wordreader.h"
+#include "wordset.h"
+
+/*
+ * On-disk layout of a saved set of filters (version 1, native byte order):
+ *
+ *   FilterFileHeader                      at offset 0
+ *   FilterFileEntry[fileCount]            at offset sizeof(FilterFileHeader)
+ *   filter bits, one section per file     at entry.filterOffset, 64-byte aligned
+ *   exact words, one section per file     at entry.wordsOffset, lowercase, '\n' separated (optional)
+ *
+ * Every filter section is the raw storage of the filter (`data()`, `bytes()`), so loading is one mmap
+ * of the whole file and the filters are used in place.
+ */
+#define FILTER_FILE_MAGIC "BLOOMFLT"
+#define FILTER_FILE_VERSION 1
+#define FILTER_FILE_NAME_SIZE 224
+
+struct FilterFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t filterType;
+    uint32_t fileCount;
+    uint32_t hashes;
+    uint32_t bits;
+    uint32_t reserved;
+    uint64_t hashSeed;
+    uint64_t filterBytes;
+    uint64_t totalBytes;
+};
+
+struct FilterFileEntry {
+    char name[FILTER_FILE_NAME_SIZE];
+    uint64_t uniqueWords;
+    uint64_t filterOffset;
+    uint64_t wordsOffset;
+    uint64_t wordsBytes;
+};
+
+/* The `filterType` value saved for each filter class; 0 for the ones that cannot be saved. */
+template <typename Filter>
+struct FilterFileType {
+    static const uint32_t value = 0;
+};
+
+template <>
+struct FilterFileType<BloomFilter> {
+    static const uint32_t value = 1;
+};
+
+template <>
+struct FilterFileType<BlockedBloomFilter> {
+    static const uint32_t value = 2;
+};
+
+template <>
+struct FilterFileType<CountingBloomFilter> {
+    static const uint32_t value = 3;
+};
+
+/**
+ * The function AlignTo64 rounds an offset up to the next multiple of 64 bytes.
+ */
+inline uint64_t AlignTo64(uint64_t offset) {
+    return (offset + 63) & ~uint64_t(63);
+}
+
+/**
+ * The function FilterFileBytes gives the size of one filter section for a saved filter type and size,
+ * the same as `bytes()` of the filter that was saved.
+ *
+ * @param filterType The `FilterFileType` value of the filter class.
+ * @param params The bits and probes saved in the header.
+ *
+ * @return the size in bytes, or 0 for a type that cannot be saved.
+ */
+inline uint64_t FilterFileBytes(uint32_t filterType, FilterParams params) {
+    if (filterType == FilterFileType<BloomFilter>::value) {
+        return BloomFilter(params, nullptr).bytes();
+    } else if (filterType == FilterFileType<BlockedBloomFilter>::value) {
+        return BlockedBloomFilter(params, nullptr).bytes();
+    } else if (filterType == FilterFileType<CountingBloomFilter>::value) {
+        return CountingBloomFilter(params, nullptr).bytes();
+    }
+    return 0;
+}
+
+/**
+ * The function InsideFile checks that a section lies inside a file of `size` bytes, without
+ * overflowing on offsets read from a damaged file.
+ */
+inline bool InsideFile(uint64_t offset, uint64_t bytes, uint64_t size) {
+    return offset <= size && bytes <= size - offset;
+}
+
+/**
+ * The function SaveFilters writes a set of filters, the names and unique word counts of the files they
+ * were built from, and optionally the exact words of each file, to a filter file.
+ *
+ * @param path The file to write.
+ * @param filters The filters, one per file. They must all have the same size and probe count.
+ * @param filenames The name of the file each filter was built from.
+ * @param uniqueWords The number of unique words inserted into each filter, of any integer type.
+ * @param exact_sets The exact words of each file, or nullptr to leave them out.
+ * @param fileCount The number of filters.
+ *
+ * @return true on success. On failure, including a short write or a failed close, an error is printed
+ * and false is returned.
+ */
+template <typename Filter, typename Count>
+bool SaveFilters(const std::string& path, const Filter filters[], const std::string filenames[], const Count uniqueWords[], const WordSet exact_sets[], int fileCount) {
+    FilterFileHeader header = {};
+    std::vector<FilterFileEntry> entries(fileCount);
+    std::vector<std::string> words(fileCount);
+
+    std::memcpy(header.magic, FILTER_FILE_MAGIC, sizeof(header.magic));
+    header.version = FILTER_FILE_VERSION;
+    header.filterType = FilterFileType<Filter>::value;
+    header.fileCount = fileCount;
+    header.hashes = filters[0].hashes();
+    header.bits = filters[0].bits();
+    header.hashSeed = HASH_SEED;
+    header.filterBytes = filters[0].bytes();
+
+    uint64_t offset = AlignTo64(sizeof(FilterFileHeader) + fileCount * sizeof(FilterFileEntry));
+    for (int i = 0; i < fileCount; ++i) {
+        std::memset(&entries[i], 0, sizeof(FilterFileEntry));
+        std::strncpy(entries[i].name, filenames[i].c_str(), FILTER_FILE_NAME_SIZE - 1);
+        entries[i].uniqueWords = uniqueWords[i];
+        entries[i].filterOffset = offset;
+        offset = AlignTo64(offset + header.filterBytes);
+    }
+    for (int i = 0; i < fileCount && exact_sets != nullptr; ++i) {
+        exact_sets[i].ForEach([&](uint64_t, std::string_view word) {
+            words[i] += word;
+            words[i] += '\n';
+        });
+        entries[i].wordsOffset = offset;
+        entries[i].wordsBytes = words[i].size();
+        offset += words[i].size();
+    }
+    header.totalBytes = offset;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open filter file for writing: " << path << std::endl;
+        return false;
+    }
+
+    /* once a write has failed, tellp() is -1 and must not be used to size the padding */
+    const char padding[64] = {};
+    uint64_t written = 0;
+    auto write = [&](const void* bytes, uint64_t count) {
+        if (file.good()) {
+            file.write(static_cast<const char*>(bytes), count);
+            written += count;
+        }
+    };
+    write(&header, sizeof(header));
+    write(entries.data(), fileCount * sizeof(FilterFileEntry));
+    for (int i = 0; i < fileCount; ++i) {
+        write(padding, entries[i].filterOffset - written);
+        write(filters[i].data(), header.filterBytes);
+    }
+    for (int i = 0; i < fileCount && exact_sets != nullptr; ++i) {
+        write(padding, entries[i].wordsOffset - written);
+        write(words[i].data(), words[i].size());
+    }
+    write(padding, header.totalBytes - written);
+
+    bool wrote = file.good() && static_cast<uint64_t>(file.tellp()) == header.totalBytes;
+    file.close();
+    if (!wrote || file.fail()) {
+        std::cerr << "Failed to write filter file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * A filter file mapped into memory. The constructor maps the file and checks the header and every
+ * entry against the size of the file; the filters are then handed out as read-only views into the
+ * mapping, so opening a file costs one `mmap` no matter how large the filters are.
+ */
+class FilterFile {
+public:
+    explicit FilterFile(const std::string& path) : file(path, MADV_WILLNEED) {
+        if (!file.is_open() || file.size() < sizeof(FilterFileHeader)) {
+            error = "cannot open " + path;
+            return;
+        }
+
+        header = reinterpret_cast<const FilterFileHeader*>(file.data());
+        entries = reinterpret_cast<const FilterFileEntry*>(file.data() + sizeof(FilterFileHeader));
+
+        if (std::memcmp(header->magic, FILTER_FILE_MAGIC, sizeof(header->magic)) != 0) {
+            error = path + " is not a filter file";
+        } else if (header->version != FILTER_FILE_VERSION) {
+            error = path + " has format version " + std::to_string(header->version) + ", expected " + std::to_string(FILTER_FILE_VERSION);
+        } else if (header->hashSeed != HASH_SEED) {
+            error = path + " was built with a different hash seed";
+        } else if (header->totalBytes != file.size()) {
+            error = path + " is truncated";
+        } else if (header->fileCount > (file.size() - sizeof(FilterFileHeader)) / sizeof(FilterFileEntry)) {
+            error = path + " has more entries than fit in the file";
+        } else if (header->bits == 0 || header->hashes == 0 || header->hashes > MAX_HASH_COUNT) {
+            error = path + " has an invalid filter size or probe count";
+        } else if (FilterFileBytes(header->filterType, params()) == 0) {
+            error = path + " holds an unknown filter type " + std::to_string(header->filterType);
+        } else if (header->filterBytes != FilterFileBytes(header->filterType, params())) {
+            error = path + " has a filter size that does not match its bits";
+        } else {
+            CheckEntries(path);
+        }
+    }
+
+    bool is_open() const { return error.empty(); }
+    const std::string& errorMessage() const { return error; }
+
+    uint32_t filterType() const { return header->filterType; }
+    int fileCount() const { return header->fileCount; }
+    FilterParams params() const { return FilterParams{header->bits, static_cast<int>(header->hashes)}; }
+    std::string name(int i) const { return std::string(entries[i].name); }
+    uint64_t uniqueWords(int i) const { return entries[i].uniqueWords; }
+    bool hasWords() const { return header->fileCount > 0 && entries[0].wordsOffset != 0; }
+
+    /**
+     * The function `filter` returns a read-only view of the i-th filter inside the mapping.
+     */
+    template <typename Filter>
+    Filter filter(int i) const {
+        return Filter(params(), file.data() + entries[i].filterOffset);
+    }
+
+    /**
+     * The function `words` returns the exact words saved for the i-th file, '\n' separated.
+     */
+    std::string_view words(int i) const {
+        return std::string_view(file.data() + entries[i].wordsOffset, entries[i].wordsBytes);
+    }
+
+private:
+    /**
+     * The function CheckEntries sets `error` unless every name is terminated and every filter and word
+     * section lies inside the mapping. Filter sections must also be 64-byte aligned, as the blocked
+     * filter reads them in place.
+     */
+    void CheckEntries(const std::string& path) {
+        for (uint32_t i = 0; i < header->fileCount; ++i) {
+            const FilterFileEntry& entry = entries[i];
+            if (std::memchr(entry.name, '\0', FILTER_FILE_NAME_SIZE) == nullptr) {
+                error = path + ": entry " + std::to_string(i) + " has an unterminated name";
+            } else if (entry.filterOffset % 64 != 0 || !InsideFile(entry.filterOffset, header->filterBytes, file.size())) {
+                error = path + ": the filter of entry " + std::to_string(i) + " lies outside the file";
+            } else if (!InsideFile(entry.wordsOffset, entry.wordsBytes, file.size())) {
+                error = path + ": the words of entry " + std::to_string(i) + " lie outside the file";
+            } else if ((entry.wordsOffset != 0) != (entries[0].wordsOffset != 0)) {
+                error = path + ": entry " + std::to_string(i) + " disagrees with the first on whether words are saved";
+            }
+            if (!error.empty()) {
+                return;
+            }
+        }
+    }
+
+    MappedFile file;
+    const FilterFileHeader* header = nullptr;
+    const FilterFileEntry* entries = nullptr;
+    std::string error;
+};
+
+#endif
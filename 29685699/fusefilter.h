@@ -0,0 +1,260 @@
+#ifndef FUSEFILTER_H
+#define FUSEFILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "bloomhash.h"
+
+#define FUSE_MAX_ATTEMPTS 100
+
+/**
+ * A binary fuse filter (Graf and Lemire, "Binary Fuse Filters: Fast and Smaller Than Xor Filters",
+ * 2022) with three probes. It is static: it is built once from the complete set of words and can only
+ * be queried afterwards. Every word maps to three slots in three consecutive segments of the
+ * fingerprint array, and the array is filled so that the XOR of those three slots is the word's
+ * fingerprint. A lookup is therefore exactly three memory reads and one compare. The false positive
+ * rate is 2^-b for b-bit fingerprints (0.39% for 8 bits, 0.0015% for 16), at about 1.13 b bits per
+ * word for large sets, with a little more for small ones.
+ *
+ * Words are given as their `HashWord` values, remixed with a seed so that a failed build (rare, and
+ * only for some seeds) can be retried with another one.
+ */
+template <typename Fingerprint>
+class BinaryFuseFilter {
+public:
+    /**
+     * This constructor builds the filter from the `HashWord` values of a set of words. Repeated values
+     * are allowed and stored once. If no seed in `FUSE_MAX_ATTEMPTS` tries gives a valid layout,
+     * `built()` is false and the filter rejects every word.
+     */
+    explicit BinaryFuseFilter(std::vector<uint64_t> hashes = std::vector<uint64_t>()) {
+        Build(hashes);
+    }
+
+    bool built() const { return ok; }
+    size_t size() const { return keyCount; }
+    uint32_t bits() const { return static_cast<uint32_t>(fingerprints.size() * sizeof(Fingerprint) * 8); }
+    /* the number of slots read per lookup */
+    int hashes() const { return 3; }
+    size_t bytes() const { return fingerprints.size() * sizeof(Fingerprint); }
+
+    /**
+     * The function `contains` checks whether the three slots of a word XOR to its fingerprint.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is probably in the filter, false if it is definitely not.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word));
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash) const {
+        if (!ok) {
+            return false;
+        }
+        uint64_t h = Mix(hash + seed);
+        uint32_t h0, h1, h2;
+        Positions(h, h0, h1, h2);
+        return static_cast<Fingerprint>(FingerprintOf(h) ^ fingerprints[h0] ^ fingerprints[h1] ^ fingerprints[h2]) == 0;
+    }
+
+    /**
+     * The function `prefetch` starts loading the three slots a later `containsHash(hash)` will read.
+     */
+    void prefetch(uint64_t hash) const {
+        if (!ok) {
+            return;
+        }
+        uint32_t h0, h1, h2;
+        Positions(Mix(hash + seed), h0, h1, h2);
+        __builtin_prefetch(&fingerprints[h0]);
+        __builtin_prefetch(&fingerprints[h1]);
+        __builtin_prefetch(&fingerprints[h2]);
+    }
+
+private:
+    /* the murmur3 finalizer */
+    static uint64_t Mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static uint64_t SplitMix(uint64_t& state) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    static Fingerprint FingerprintOf(uint64_t h) {
+        return static_cast<Fingerprint>(h ^ (h >> 32));
+    }
+
+    /* the slots of a word in segments s, s + 1 and s + 2, where s comes from the high bits of the hash */
+    void Positions(uint64_t h, uint32_t& h0, uint32_t& h1, uint32_t& h2) const {
+        uint64_t slot = static_cast<uint64_t>((static_cast<unsigned __int128>(h) * segmentCountLength) >> 64);
+        h0 = static_cast<uint32_t>(slot);
+        h1 = static_cast<uint32_t>((slot + segmentLength) ^ ((h >> 18) & segmentLengthMask));
+        h2 = static_cast<uint32_t>((slot + 2 * segmentLength) ^ (h & segmentLengthMask));
+    }
+
+    /**
+     * The function Sizes picks the segment length and count for `n` words: segments grow with the set
+     * so that the three slots of a word stay close together, and the array is about 1.125 n slots for
+     * large sets, relatively more for small ones, rounded to whole segments.
+     */
+    void Sizes(uint32_t n) {
+        segmentLength = n == 0 ? 4 : uint32_t(1) << static_cast<int>(std::floor(std::log(double(n)) / std::log(3.33) + 2.25));
+        segmentLength = std::min<uint32_t>(segmentLength, 262144);
+        segmentLengthMask = segmentLength - 1;
+
+        double sizeFactor = n <= 1 ? 0 : std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / std::log(double(n)));
+        uint64_t capacity = n <= 1 ? 0 : static_cast<uint64_t>(std::llround(n * sizeFactor));
+        int64_t segments = static_cast<int64_t>((capacity + segmentLength - 1) / segmentLength) - 2;
+        segmentCount = segments <= 0 ? 1 : static_cast<uint32_t>(segments);
+        segmentCountLength = segmentCount * segmentLength;
+        fingerprints.assign(static_cast<size_t>(segmentCount + 2) * segmentLength, 0);
+    }
+
+    /**
+     * The function Build peels the 3-hypergraph of the words: a slot used by a single word can take any
+     * value, so that word is set aside and removed from its other two slots, which may free more slots.
+     * If every word is peeled the fingerprints are assigned in reverse order, each word fixing its own
+     * free slot; otherwise a new seed is tried.
+     */
+    void Build(std::vector<uint64_t>& keys) {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        uint32_t n = static_cast<uint32_t>(keys.size());
+        keyCount = n;
+        Sizes(n);
+
+        size_t arrayLength = fingerprints.size();
+        std::vector<uint64_t> order(n + 1, 0);
+        std::vector<uint8_t> peeledSlot(n);
+        /* per slot: number of words * 4, plus the XOR of which of their three slots (0-2) this is */
+        std::vector<uint8_t> slotCount(arrayLength);
+        std::vector<uint64_t> slotHash(arrayLength);
+        std::vector<uint32_t> alone(arrayLength);
+
+        int blockBits = 1;
+        while ((uint32_t(1) << blockBits) < segmentCount) {
+            blockBits++;
+        }
+        uint32_t blocks = uint32_t(1) << blockBits;
+        std::vector<uint32_t> startPos(blocks);
+        uint64_t rng = 0x726b2b9d438b9d4dull;
+
+        for (int attempt = 0; attempt < FUSE_MAX_ATTEMPTS; ++attempt) {
+            seed = SplitMix(rng);
+            std::fill(order.begin(), order.end(), 0);
+            std::fill(slotCount.begin(), slotCount.end(), 0);
+            std::fill(slotHash.begin(), slotHash.end(), 0);
+            order[n] = 1;
+
+            /* sort the hashes roughly by segment, so the counting pass below walks the array in order */
+            for (uint32_t i = 0; i < blocks; ++i) {
+                startPos[i] = static_cast<uint32_t>((uint64_t(i) * n) >> blockBits);
+            }
+            for (uint32_t i = 0; i < n; ++i) {
+                uint64_t h = Mix(keys[i] + seed);
+                uint32_t block = static_cast<uint32_t>(h >> (64 - blockBits));
+                while (order[startPos[block]] != 0) {
+                    block = (block + 1) & (blocks - 1);
+                }
+                order[startPos[block]] = h;
+                startPos[block]++;
+            }
+
+            bool error = false;
+            for (uint32_t i = 0; i < n; ++i) {
+                uint64_t h = order[i];
+                uint32_t h0, h1, h2;
+                Positions(h, h0, h1, h2);
+                slotCount[h0] += 4;
+                slotHash[h0] ^= h;
+                slotCount[h1] += 4;
+                slotCount[h1] ^= 1;
+                slotHash[h1] ^= h;
+                slotCount[h2] += 4;
+                slotCount[h2] ^= 2;
+                slotHash[h2] ^= h;
+                /* a slot count that wraps around means too many words share it for this seed */
+                error = error || slotCount[h0] < 4 || slotCount[h1] < 4 || slotCount[h2] < 4;
+            }
+            if (error) {
+                continue;
+            }
+
+            uint32_t queued = 0;
+            for (uint32_t i = 0; i < arrayLength; ++i) {
+                alone[queued] = i;
+                queued += (slotCount[i] >> 2) == 1;
+            }
+
+            uint32_t peeled = 0;
+            while (queued > 0) {
+                uint32_t index = alone[--queued];
+                if ((slotCount[index] >> 2) != 1) {
+                    continue;
+                }
+                uint64_t h = slotHash[index];
+                uint32_t slots[5];
+                Positions(h, slots[0], slots[1], slots[2]);
+                slots[3] = slots[0];
+                slots[4] = slots[1];
+                uint8_t found = slotCount[index] & 3;
+                peeledSlot[peeled] = found;
+                order[peeled] = h;
+                peeled++;
+
+                for (int k = 1; k <= 2; ++k) {
+                    uint32_t other = slots[found + k];
+                    alone[queued] = other;
+                    queued += (slotCount[other] >> 2) == 2;
+                    slotCount[other] -= 4;
+                    slotCount[other] ^= (found + k) % 3;
+                    slotHash[other] ^= h;
+                }
+            }
+
+            if (peeled == n) {
+                for (uint32_t i = n; i-- > 0;) {
+                    uint64_t h = order[i];
+                    uint32_t slots[5];
+                    Positions(h, slots[0], slots[1], slots[2]);
+                    slots[3] = slots[0];
+                    slots[4] = slots[1];
+                    uint8_t found = peeledSlot[i];
+                    fingerprints[slots[found]] = static_cast<Fingerprint>(FingerprintOf(h) ^ fingerprints[slots[found + 1]] ^ fingerprints[slots[found + 2]]);
+                }
+                ok = true;
+                return;
+            }
+        }
+        ok = false;
+    }
+
+    uint64_t seed = 0;
+    uint32_t segmentLength = 0;
+    uint32_t segmentLengthMask = 0;
+    uint32_t segmentCount = 0;
+    uint32_t segmentCountLength = 0;
+    size_t keyCount = 0;
+    bool ok = false;
+    std::vector<Fingerprint> fingerprints;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+#include "bitslicedindex.h"
+#include "bloomfilter.h"
+#include "wordreader.h"
+
+#define REPEATS 5
+#define FP_RATE 0.01
+
+/* Time and checksum of one way of answering the queries, compared between layouts. */
+struct LookupResult {
+    long long matches = 0;
+    uint64_t checksum = 0;
+    long long microseconds = 0;
+};
+
+/**
+ * The function PerFileLookup answers every query by probing each document's own `BloomFilter` in
+ * turn, which is how `bfparallelQuery` uses its filters.
+ *
+ * @param filters One filter per document.
+ * @param hashes The `HashWord` values of the queries.
+ *
+ * @return the number of (query, document) candidates and a checksum of which they were.
+ */
+LookupResult PerFileLookup(const std::vector<BloomFilter>& filters, const std::vector<uint64_t>& hashes) {
+    LookupResult result;
+    for (size_t q = 0; q < hashes.size(); ++q) {
+        for (size_t d = 0; d < filters.size(); ++d) {
+            if (filters[d].containsHash(hashes[q])) {
+                result.matches++;
+                result.checksum += (q + 1) * (d + 1);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * The function SlicedLookup answers every query with one `candidatesHash` call on the bit-sliced
+ * index and walks the candidate mask.
+ *
+ * @param index The index holding every document.
+ * @param hashes The `HashWord` values of the queries.
+ *
+ * @return the number of (query, document) candidates and a checksum of which they were.
+ */
+LookupResult SlicedLookup(const BitSlicedIndex& index, const std::vector<uint64_t>& hashes) {
+    LookupResult result;
+    std::vector<uint64_t> mask(index.maskWords());
+    for (size_t q = 0; q < hashes.size(); ++q) {
+        if (!index.candidatesHash(hashes[q], mask.data())) {
+            continue;
+        }
+        for (int w = 0; w < index.maskWords(); ++w) {
+            for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1) {
+                size_t d = w * 64 + __builtin_ctzll(bits);
+                result.matches++;
+                result.checksum += (q + 1) * (d + 1);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * The function TimeBest runs a lookup `REPEATS` times and keeps the fastest run.
+ */
+template <typename Func>
+LookupResult TimeBest(Func&& lookup) {
+    LookupResult best;
+    best.microseconds = -1;
+
+    for (int i = 0; i < REPEATS; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        LookupResult result = lookup();
+        auto end = std::chrono::high_resolution_clock::now();
+        result.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (best.microseconds < 0 || result.microseconds < best.microseconds) {
+            best = result;
+        }
+    }
+    return best;
+}
+
+/**
+ * The main function cuts the sample books into a growing number of equal documents, builds one
+ * `BloomFilter` per document and one `BitSlicedIndex` over all of them with the same parameters,
+ * and times answering `query.txt` ("which documents may contain this word") with both layouts.
+ *
+ * @return 0 if both layouts return the same candidates for every document count, 1 otherwise.
+ */
+int main() {
+    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt"};
+    const int documentCounts[] = {4, 64, 512, 2048};
+    std::vector<uint64_t> words;
+    std::vector<uint64_t> queries;
+    int status = 0;
+
+    for (const auto& filename : filenames) {
+        MappedFile file(filename);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file" << std::endl;
+            exit(1);
+        }
+        ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+            words.push_back(HashWord(word));
+        });
+    }
+
+    MappedFile query_file("query.txt");
+    if (!query_file.is_open()) {
+        std::cerr << "Failed to open query file" << std::endl;
+        exit(1);
+    }
+    ForEachQueryWord(query_file.data(), query_file.data() + query_file.size(), [&](std::string_view word) {
+        queries.push_back(HashWord(word));
+    });
+
+    std::cout << words.size() << " words, " << queries.size() << " queries, best of " << REPEATS << ":\n";
+
+    for (int documents : documentCounts) {
+        size_t wordsPerDocument = (words.size() + documents - 1) / documents;
+        FilterParams params = OptimalParams(wordsPerDocument, FP_RATE);
+        std::vector<BloomFilter> filters;
+        BitSlicedIndex index(params, documents);
+
+        for (int d = 0; d < documents; ++d) {
+            filters.emplace_back(params);
+        }
+        for (size_t w = 0; w < words.size(); ++w) {
+            filters[w / wordsPerDocument].insertHash(words[w]);
+            index.insertHash(w / wordsPerDocument, words[w]);
+        }
+
+        LookupResult perFile = TimeBest([&] { return PerFileLookup(filters, queries); });
+        LookupResult sliced = TimeBest([&] { return SlicedLookup(index, queries); });
+
+        std::cout << "  " << documents << " documents (" << params.bits << " bits, " << params.hashes << " hashes each): "
+                  << "per-file filters " << perFile.microseconds / 1000.0 << " ms, "
+                  << "bit-sliced index " << sliced.microseconds / 1000.0 << " ms, "
+                  << sliced.matches << " candidates.\n";
+
+        if (perFile.matches != sliced.matches || perFile.checksum != sliced.checksum) {
+            std::cerr << "Layouts disagree at " << documents << " documents" << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
@@ -7,17 +7,9 @@
 #SBATCH --output=omp.%j.out
 #SBATCH --partition=defq
 
-if [ ! -f omp ]
-then
- g++ bfparallel.cpp -fopenmp -o omp
-else
- if [ omp.c -nt omp ]
- then
-  g++ bfparallel.cpp -fopenmp -o omp
- fi
-fi
+make bfparallel
 
 export OMP_NUM_THREADS=$SLURM_CPUS_PER_TASK
-./omp
+./bfparallel
 
 exit 0
\ No newline at end of file
@@ -0,0 +1,293 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* The counters read for every phase: five hardware events, then two software events that need no PMU. */
+enum PerfEvent {
+    EVENT_CYCLES,
+    EVENT_INSTRUCTIONS,
+    EVENT_LLC_MISSES,
+    EVENT_BRANCH_MISSES,
+    EVENT_DTLB_MISSES,
+    EVENT_TASK_CLOCK,
+    EVENT_PAGE_FAULTS,
+    EVENT_COUNT
+};
+
+/* The steps of a run that `PhaseProfiler` attributes counters to. */
+enum ProfilePhase {
+    PHASE_READ,
+    PHASE_TOKENIZE,
+    PHASE_HASH,
+    PHASE_INSERT,
+    PHASE_QUERY,
+    PHASE_VERIFY,
+    PHASE_COUNT
+};
+
+inline const char* EventName(int event) {
+    static const char* const names[EVENT_COUNT] = {"cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses", "task_clock_ns", "page_faults"};
+    return names[event];
+}
+
+inline const char* PhaseName(int phase) {
+    static const char* const names[PHASE_COUNT] = {"read", "tokenize", "hash", "insert", "query", "verify"};
+    return names[phase];
+}
+
+/* One reading of every counter of a thread; unavailable counters stay 0. */
+struct CounterSample {
+    uint64_t values[EVENT_COUNT] = {};
+};
+
+/**
+ * The per-thread counters behind `PhaseProfiler`. `perf_event_open` counts only the calling thread
+ * when given pid 0, so every thread opens its own set, in user space only (which
+ * `perf_event_paranoid` up to 2 allows). Each counter is opened on its own rather than as a group,
+ * so a machine without a PMU, such as most virtual machines, still gets the software counters. When
+ * the kernel multiplexes the hardware counters, readings are scaled by the share of time they ran.
+ */
+class PerfCounters {
+public:
+    PerfCounters() {
+        static const uint32_t types[EVENT_COUNT] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                    PERF_TYPE_HW_CACHE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE};
+        static const uint64_t configs[EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS};
+
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[e];
+            attr.config = configs[e];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds[e] < 0) {
+                errors[e] = errno;
+            }
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available(int event) const { return fds[event] >= 0; }
+    /* the errno of a counter that could not be opened, 0 if it is open */
+    int error(int event) const { return errors[event]; }
+
+    /**
+     * The function `read` takes one reading of every open counter. It is one `read` system call per
+     * counter, so it belongs at phase boundaries, not in per-word loops.
+     */
+    CounterSample read() const {
+        CounterSample sample;
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            uint64_t data[3];
+            if (fds[e] < 0 || ::read(fds[e], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+                continue;
+            }
+            sample.values[e] = data[2] > 0 && data[2] < data[1] ? static_cast<uint64_t>(double(data[0]) * data[1] / data[2]) : data[0];
+        }
+        return sample;
+    }
+
+    /**
+     * The function ForThisThread returns the counters of the calling thread, opening them on first use.
+     * OpenMP keeps its threads between parallel regions, so they are opened once per thread.
+     */
+    static const PerfCounters& ForThisThread() {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+
+private:
+    int fds[EVENT_COUNT];
+    int errors[EVENT_COUNT] = {};
+};
+
+/**
+ * A profile of one run: the counters, wall time and item count (bytes for reading, words otherwise)
+ * of every phase on every thread. A thread calls `start` before a phase and `record` after it, both
+ * from the same thread, with its own thread index so that no two threads write the same entry.
+ */
+class PhaseProfiler {
+public:
+    /* where a phase started on the calling thread */
+    struct Mark {
+        CounterSample sample;
+        std::chrono::high_resolution_clock::time_point time;
+    };
+
+    /* the totals of one phase on one thread */
+    struct Entry {
+        CounterSample counts;
+        long long microseconds = 0;
+        long long items = 0;
+        int calls = 0;
+    };
+
+    explicit PhaseProfiler(int threads) : entries(threads, std::vector<Entry>(PHASE_COUNT)) {}
+
+    Mark start() const {
+        Mark mark;
+        mark.sample = PerfCounters::ForThisThread().read();
+        mark.time = std::chrono::high_resolution_clock::now();
+        return mark;
+    }
+
+    void record(int thread, ProfilePhase phase, const Mark& mark, long long items) {
+        auto now = std::chrono::high_resolution_clock::now();
+        CounterSample sample = PerfCounters::ForThisThread().read();
+        Entry& entry = entries[thread][phase];
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            entry.counts.values[e] += sample.values[e] - mark.sample.values[e];
+        }
+        entry.microseconds += std::chrono::duration_cast<std::chrono::microseconds>(now - mark.time).count();
+        entry.items += items;
+        entry.calls++;
+    }
+
+    /**
+     * The function printReport prints one line per phase with the totals over all threads, followed by
+     * the line of every thread that took part, and says which counters could not be opened and why.
+     */
+    void printReport() const {
+        const PerfCounters& counters = PerfCounters::ForThisThread();
+        std::cout << "Profile (counts in user space; cycles and misses per item):\n";
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            if (!counters.available(e)) {
+                std::cout << "  " << EventName(e) << " not available: " << std::strerror(counters.error(e))
+                          << (counters.error(e) == EACCES ? " (see /proc/sys/kernel/perf_event_paranoid)" : "") << "\n";
+            }
+        }
+
+        std::cout << "  " << std::left << std::setw(10) << "phase" << std::setw(8) << "thread" << std::right << std::setw(10) << "items"
+                  << std::setw(10) << "ms" << std::setw(10) << "cpu ms" << std::setw(9) << "faults" << std::setw(10) << "cyc/item"
+                  << std::setw(7) << "IPC" << std::setw(10) << "LLC/item" << std::setw(10) << "br/item" << std::setw(10) << "dTLB/item" << "\n";
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            Entry total = Total(p);
+            if (total.calls == 0) {
+                continue;
+            }
+            PrintLine(PhaseName(p), "all", total, counters);
+            for (size_t t = 0; t < entries.size(); ++t) {
+                if (entries[t][p].calls > 0) {
+                    PrintLine("", std::to_string(t), entries[t][p], counters);
+                }
+            }
+        }
+    }
+
+    /**
+     * The function writeJson writes every phase of every thread with its raw counts, null for the
+     * counters that could not be opened.
+     *
+     * @param path The file to write.
+     */
+    void writeJson(const std::string& path) const {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << path << " for writing" << std::endl;
+            exit(1);
+        }
+
+        const PerfCounters& counters = PerfCounters::ForThisThread();
+        out << "{\n  \"threads\": " << entries.size() << ",\n  \"phases\": [";
+        bool first = true;
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            for (size_t t = 0; t < entries.size(); ++t) {
+                const Entry& entry = entries[t][p];
+                if (entry.calls == 0) {
+                    continue;
+                }
+                out << (first ? "\n" : ",\n") << "    {\"phase\": \"" << PhaseName(p) << "\", \"thread\": " << t << ", \"items\": " << entry.items
+                    << ", \"microseconds\": " << entry.microseconds;
+                for (int e = 0; e < EVENT_COUNT; ++e) {
+                    out << ", \"" << EventName(e) << "\": ";
+                    if (counters.available(e)) {
+                        out << entry.counts.values[e];
+                    } else {
+                        out << "null";
+                    }
+                }
+                out << "}";
+                first = false;
+            }
+        }
+        out << "\n  ]\n}\n";
+    }
+
+private:
+    Entry Total(int phase) const {
+        Entry total;
+        for (const auto& thread : entries) {
+            const Entry& entry = thread[phase];
+            for (int e = 0; e < EVENT_COUNT; ++e) {
+                total.counts.values[e] += entry.counts.values[e];
+            }
+            total.microseconds = std::max(total.microseconds, entry.microseconds);
+            total.items += entry.items;
+            total.calls += entry.calls;
+        }
+        return total;
+    }
+
+    static void PrintLine(const std::string& phase, const std::string& thread, const Entry& entry, const PerfCounters& counters) {
+        const uint64_t* v = entry.counts.values;
+        double items = entry.items > 0 ? double(entry.items) : 1.0;
+        auto perItem = [&](int e) -> std::string {
+            if (!counters.available(e)) {
+                return "-";
+            }
+            std::ostringstream text;
+            text << std::fixed << std::setprecision(e == EVENT_CYCLES ? 1 : 3) << v[e] / items;
+            return text.str();
+        };
+        std::string ipc = "-";
+        if (counters.available(EVENT_CYCLES) && counters.available(EVENT_INSTRUCTIONS) && v[EVENT_CYCLES] > 0) {
+            std::ostringstream text;
+            text << std::fixed << std::setprecision(2) << double(v[EVENT_INSTRUCTIONS]) / v[EVENT_CYCLES];
+            ipc = text.str();
+        }
+
+        std::cout << "  " << std::left << std::setw(10) << phase << std::setw(8) << thread << std::right << std::setw(10) << entry.items
+                  << std::setw(10) << std::fixed << std::setprecision(2) << entry.microseconds / 1000.0 << std::setw(10)
+                  << (counters.available(EVENT_TASK_CLOCK) ? v[EVENT_TASK_CLOCK] / 1e6 : 0.0) << std::setw(9) << v[EVENT_PAGE_FAULTS]
+                  << std::setw(10) << perItem(EVENT_CYCLES) << std::setw(7) << ipc << std::setw(10) << perItem(EVENT_LLC_MISSES)
+                  << std::setw(10) << perItem(EVENT_BRANCH_MISSES) << std::setw(10) << perItem(EVENT_DTLB_MISSES) << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+
+    std::vector<std::vector<Entry>> entries;
+};
+
+#endif
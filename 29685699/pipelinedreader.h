@@ -0,0 +1,632 @@
+#ifndef PIPELINEDREADER_H
+#define PIPELINEDREADER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <omp.h>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "chunkedreader.h"
+#include "wordreader.h"
+
+#define PIPELINE_BUFFER_SIZE (1 << 20)
+#define PIPELINE_DEPTH 8
+/* room in front of every buffer for the unfinished word of the buffer before it */
+#define PIPELINE_CARRY_SIZE (64 * 1024)
+/* the largest buffer and the most buffers (each with a read, and a pread thread, of its own) accepted */
+#define PIPELINE_MAX_BUFFER_SIZE (1ull << 30)
+#define PIPELINE_MAX_DEPTH 256
+
+/**
+ * A minimal io_uring with one submission and one completion queue, set up with the raw system calls
+ * so no liburing is needed. Only reads are submitted. It is used by one thread, which owns the tails
+ * it writes and the heads it reads; the kernel side is synchronized with acquire and release.
+ */
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            errorNumber = errno;
+            return;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = Map(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = singleMap ? sqRing : Map(cqRingSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(Map(sqesSize, IORING_OFF_SQES));
+        if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr) {
+            errorNumber = errno;
+            return;
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~IoUring() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != nullptr && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != nullptr) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool is_open() const { return fd >= 0 && sqes != nullptr; }
+    /* the errno of a failed setup, such as ENOSYS or EPERM where io_uring is not allowed */
+    int error() const { return errorNumber; }
+
+    /**
+     * The function submitRead queues a read of `length` bytes at `offset` of `file` into `buffer` and
+     * hands it to the kernel. Its completion carries `tag`.
+     *
+     * @return false if the queue is full or the submission failed.
+     */
+    bool submitRead(int file, char* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            return false;
+        }
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = static_cast<uint32_t>(length);
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        while (syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The function wait blocks until a read completes.
+     *
+     * @param tag Receives the tag the read was submitted with.
+     * @param result Receives the bytes read, or minus the errno of a failed read.
+     *
+     * @return false if waiting itself failed (`errno` is left set); no completion is returned then.
+     */
+    bool wait(uint64_t& tag, long long& result) {
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes[head & cqMask];
+                tag = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+private:
+    void* Map(size_t size, off_t offset) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return address == MAP_FAILED ? nullptr : address;
+    }
+
+    int fd = -1;
+    int errorNumber = 0;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+};
+
+/**
+ * A bounded first-in first-out queue of buffer numbers between threads. `pop` blocks while it is
+ * empty and adds the time it waited to the caller's counter.
+ */
+class BufferRing {
+public:
+    explicit BufferRing(size_t capacity) : slots(capacity) {}
+
+    void push(int buffer) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [&] { return count < slots.size(); });
+        slots[(first + count) % slots.size()] = buffer;
+        count++;
+        notEmpty.notify_one();
+    }
+
+    int pop(long long& waitMicroseconds) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (count == 0) {
+            auto start = std::chrono::high_resolution_clock::now();
+            notEmpty.wait(lock, [&] { return count > 0; });
+            auto end = std::chrono::high_resolution_clock::now();
+            waitMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        }
+        int buffer = slots[first];
+        first = (first + 1) % slots.size();
+        count--;
+        notFull.notify_one();
+        return buffer;
+    }
+
+    /* pop without blocking; returns -1 when the ring is empty */
+    int tryPop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == 0) {
+            return -1;
+        }
+        int buffer = slots[first];
+        first = (first + 1) % slots.size();
+        count--;
+        notFull.notify_one();
+        return buffer;
+    }
+
+private:
+    std::vector<int> slots;
+    size_t first = 0;
+    size_t count = 0;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+/**
+ * The fallback when io_uring cannot be set up: a pool of threads that each take a read request, do it
+ * with a blocking `pread`, and queue its completion, so as many reads are in flight as there are
+ * threads. It has the same `submitRead` and `wait` as `IoUring`.
+ */
+class PreadPool {
+public:
+    explicit PreadPool(int threads) {
+        for (int i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { Work(); });
+        }
+    }
+
+    ~PreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        requestReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    PreadPool(const PreadPool&) = delete;
+    PreadPool& operator=(const PreadPool&) = delete;
+
+    bool submitRead(int file, char* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back(Request{file, buffer, length, offset, tag, 0});
+        }
+        requestReady.notify_one();
+        return true;
+    }
+
+    bool wait(uint64_t& tag, long long& result) {
+        std::unique_lock<std::mutex> lock(mutex);
+        completionReady.wait(lock, [&] { return !completions.empty(); });
+        tag = completions.front().tag;
+        result = completions.front().result;
+        completions.pop_front();
+        return true;
+    }
+
+private:
+    struct Request {
+        int file;
+        char* buffer;
+        size_t length;
+        uint64_t offset;
+        uint64_t tag;
+        long long result;
+    };
+
+    void Work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            requestReady.wait(lock, [&] { return stopping || !requests.empty(); });
+            if (requests.empty()) {
+                return;
+            }
+            Request request = requests.front();
+            requests.pop_front();
+
+            lock.unlock();
+            ssize_t n;
+            do {
+                n = pread(request.file, request.buffer, request.length, request.offset);
+            } while (n < 0 && errno == EINTR);
+            request.result = n < 0 ? -errno : n;
+            lock.lock();
+
+            completions.push_back(request);
+            completionReady.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<Request> requests;
+    std::deque<Request> completions;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable requestReady;
+    std::condition_variable completionReady;
+};
+
+/**
+ * The function PreadFully reads `[filled, length)` of a buffer at `offset + filled` of a file, calling
+ * `pread` until the buffer is full.
+ *
+ * @param filled The bytes of the buffer already read; advanced as reads return.
+ *
+ * @return 0 once the buffer is full, the errno of a failed read, or -1 if the file ends first.
+ */
+inline int PreadFully(int fd, char* buffer, size_t length, uint64_t offset, size_t& filled) {
+    while (filled < length) {
+        ssize_t n = pread(fd, buffer + filled, length - filled, offset + filled);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        filled += n;
+    }
+    return 0;
+}
+
+/* What `PipelinedForEachWord` did: the I/O side, then one `ThreadStats` entry per worker. */
+struct PipelineStats {
+    std::string backend;
+    /* why io_uring was not used, empty if it was or was not asked for */
+    std::string fallbackReason;
+    /* a file that could not be opened, empty on success */
+    std::string failedFile;
+    /* why reading stopped early, empty on success; the words read so far are then incomplete */
+    std::string readError;
+    size_t bytes = 0;
+    int reads = 0;
+    /* time the workers waited for a filled buffer, summed over the workers */
+    long long workerWaitMicroseconds = 0;
+    /* time the reader waited for a buffer to be handed back, with no read in flight */
+    long long readerWaitMicroseconds = 0;
+    std::vector<ThreadStats> threads;
+};
+
+/**
+ * The function PipelinedForEachWord reads files through a fixed set of `depth` buffers that are
+ * filled ahead of the workers, so reading and tokenizing overlap instead of each thread waiting on the
+ * disk and then hashing. One reader thread keeps every free buffer in flight, reading the next
+ * `bufferSize` bytes of the files in order with io_uring, or with a pool of `pread` threads if io_uring
+ * is not available or `useUring` is false. Filled buffers are handed to the OpenMP threads in file
+ * order through a ring and handed back when tokenized.
+ *
+ * Buffers are cut at the last whitespace. The unfinished word at the end is copied to the front of
+ * the next buffer of the same file, which keeps `PIPELINE_CARRY_SIZE` bytes free for it, so the words
+ * are exactly those of `ForEachWord` over the whole file. A word longer than that is cut.
+ *
+ * A read that fails, or a file that ends before the size it had when opened, stops the pipeline:
+ * no further buffers are handed out and `readError` says why, so the caller can fail the run rather
+ * than count a truncated file.
+ *
+ * @param filenames The files to read, one after the other.
+ * @param bufferSize The size of one read in bytes, from `PIPELINE_CARRY_SIZE` to
+ * `PIPELINE_MAX_BUFFER_SIZE`.
+ * @param depth The number of buffers, which is also the number of reads kept in flight, from 1 to
+ * `PIPELINE_MAX_DEPTH`.
+ * @param useUring Whether to try io_uring before the `pread` pool.
+ * @param func A callable taking `(int thread, int file, std::string_view word)`. It is called
+ * concurrently from every thread, so anything it writes to must be thread-safe or indexed by `thread`.
+ *
+ * @return the backend used, the bytes and reads, the waiting on either side of the ring, and the
+ * words, bytes, buffers and busy time of every worker.
+ */
+template <typename Func>
+PipelineStats PipelinedForEachWord(const std::vector<std::string>& filenames, size_t bufferSize, int depth, bool useUring, Func&& func) {
+    struct Buffer {
+        std::vector<char> data;
+        int file = 0;
+        uint64_t offset = 0;
+        size_t length = 0;
+        size_t filled = 0;
+        size_t begin = 0;
+        size_t end = 0;
+        bool done = false;
+    };
+    /* one read: `length` bytes at `offset` of `file` */
+    struct ReadTask {
+        int file;
+        uint64_t offset;
+        size_t length;
+    };
+
+    PipelineStats stats;
+
+    std::vector<int> fds;
+    std::vector<ReadTask> tasks;
+    for (int f = 0; f < static_cast<int>(filenames.size()); ++f) {
+        int fd = open(filenames[f].c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            stats.failedFile = filenames[f];
+            for (int opened : fds) {
+                close(opened);
+            }
+            return stats;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        fds.push_back(fd);
+        for (uint64_t offset = 0; offset < static_cast<uint64_t>(info.st_size); offset += bufferSize) {
+            tasks.push_back(ReadTask{f, offset, std::min<size_t>(bufferSize, info.st_size - offset)});
+        }
+    }
+
+    int threads = omp_get_max_threads();
+    /* declared before the ring and the pool, so that they are gone before the buffers they read into */
+    std::vector<Buffer> buffers(depth);
+    for (auto& buffer : buffers) {
+        buffer.data.resize(PIPELINE_CARRY_SIZE + bufferSize);
+    }
+
+    std::unique_ptr<IoUring> ring;
+    std::unique_ptr<PreadPool> pool;
+    if (useUring) {
+        ring = std::make_unique<IoUring>(depth);
+        if (!ring->is_open()) {
+            stats.fallbackReason = std::string("io_uring not available: ") + std::strerror(ring->error());
+            ring.reset();
+        }
+    }
+    if (ring) {
+        stats.backend = "io_uring";
+    } else {
+        pool = std::make_unique<PreadPool>(depth);
+        stats.backend = "pread pool";
+    }
+    auto submit = [&](int fd, char* buffer, size_t length, uint64_t offset, uint64_t tag) {
+        return ring ? ring->submitRead(fd, buffer, length, offset, tag) : pool->submitRead(fd, buffer, length, offset, tag);
+    };
+    auto wait = [&](uint64_t& tag, long long& result) {
+        return ring ? ring->wait(tag, result) : pool->wait(tag, result);
+    };
+    /* reads the rest of a buffer with pread, for a read io_uring failed or would not take */
+    auto finishDirectly = [&](Buffer& buffer) {
+        int error = PreadFully(fds[buffer.file], buffer.data.data() + PIPELINE_CARRY_SIZE, buffer.length, buffer.offset, buffer.filled);
+        if (error != 0) {
+            stats.readError = filenames[buffer.file] + ": " + (error < 0 ? "file is shorter than when it was opened" : std::strerror(error));
+            return false;
+        }
+        buffer.done = true;
+        return true;
+    };
+
+    BufferRing freeBuffers(depth);
+    BufferRing filledBuffers(depth + threads);
+    for (int b = 0; b < depth; ++b) {
+        freeBuffers.push(b);
+    }
+    stats.threads.resize(threads);
+
+    std::thread reader([&] {
+        std::vector<int> bufferOfTask(tasks.size(), -1);
+        std::string carry;
+        size_t next = 0;
+        size_t published = 0;
+        int inFlight = 0;
+
+        while (published < tasks.size() && stats.readError.empty()) {
+            /* keep every free buffer reading; block for one only when nothing is in flight */
+            while (next < tasks.size()) {
+                int b = inFlight > 0 ? freeBuffers.tryPop() : freeBuffers.pop(stats.readerWaitMicroseconds);
+                if (b < 0) {
+                    break;
+                }
+                Buffer& buffer = buffers[b];
+                buffer.file = tasks[next].file;
+                buffer.offset = tasks[next].offset;
+                buffer.length = tasks[next].length;
+                buffer.filled = 0;
+                buffer.done = false;
+                bufferOfTask[next++] = b;
+                if (!submit(fds[buffer.file], buffer.data.data() + PIPELINE_CARRY_SIZE, buffer.length, buffer.offset, b)) {
+                    stats.reads++;
+                    finishDirectly(buffer);
+                    break;
+                }
+                inFlight++;
+            }
+            if (!stats.readError.empty()) {
+                break;
+            }
+
+            if (inFlight > 0) {
+                uint64_t tag;
+                long long result;
+                if (!wait(tag, result)) {
+                    stats.readError = std::string("waiting for reads failed: ") + std::strerror(errno);
+                    /* the ring cannot be reaped any more; tearing it down cancels the reads */
+                    inFlight = 0;
+                    break;
+                }
+                inFlight--;
+                stats.reads++;
+
+                Buffer& buffer = buffers[tag];
+                if (result > 0) {
+                    buffer.filled += result;
+                }
+                if (buffer.filled < buffer.length) {
+                    /* a short read, or one to try again; ask for the rest */
+                    bool retry = result > 0 || result == -EINTR || result == -EAGAIN;
+                    if (retry && submit(fds[buffer.file], buffer.data.data() + PIPELINE_CARRY_SIZE + buffer.filled, buffer.length - buffer.filled,
+                                        buffer.offset + buffer.filled, tag)) {
+                        inFlight++;
+                        continue;
+                    }
+                    /* an error io_uring reports, such as an unsupported read, or the end of the file;
+                       pread either finishes the buffer or says what is wrong */
+                    if (!finishDirectly(buffer)) {
+                        break;
+                    }
+                }
+                buffer.done = true;
+            }
+
+            /* publish the finished buffers in file order, moving each unfinished last word forward */
+            while (published < tasks.size() && bufferOfTask[published] >= 0 && buffers[bufferOfTask[published]].done) {
+                Buffer& buffer = buffers[bufferOfTask[published]];
+                char* data = buffer.data.data();
+                buffer.begin = PIPELINE_CARRY_SIZE - carry.size();
+                std::memcpy(data + buffer.begin, carry.data(), carry.size());
+                buffer.end = PIPELINE_CARRY_SIZE + buffer.filled;
+                carry.clear();
+
+                bool lastOfFile = published + 1 == tasks.size() || tasks[published + 1].file != buffer.file;
+                if (!lastOfFile) {
+                    size_t cut = buffer.end;
+                    while (cut > buffer.begin && !IsSpace(data[cut - 1])) {
+                        cut--;
+                    }
+                    if (buffer.end - cut <= PIPELINE_CARRY_SIZE) {
+                        carry.assign(data + cut, buffer.end - cut);
+                        buffer.end = cut;
+                    }
+                }
+                stats.bytes += buffer.filled;
+                filledBuffers.push(bufferOfTask[published]);
+                published++;
+            }
+        }
+
+        /* after a failure, let the reads still in flight finish before their buffers can go away */
+        uint64_t tag;
+        long long result;
+        while (inFlight > 0 && wait(tag, result)) {
+            inFlight--;
+        }
+
+        /* one end marker per worker */
+        for (int t = 0; t < threads; ++t) {
+            filledBuffers.push(-1);
+        }
+    });
+
+    std::vector<long long> waits(threads, 0);
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        int b;
+        while ((b = filledBuffers.pop(waits[t])) >= 0) {
+            auto start = std::chrono::high_resolution_clock::now();
+            const Buffer& buffer = buffers[b];
+            stats.threads[t].words += ForEachWord(buffer.data.data() + buffer.begin, buffer.data.data() + buffer.end,
+                                                  [&](std::string_view word) { func(t, buffer.file, word); });
+            auto end = std::chrono::high_resolution_clock::now();
+
+            stats.threads[t].bytes += buffer.end - buffer.begin;
+            stats.threads[t].tasks++;
+            stats.threads[t].microseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            freeBuffers.push(b);
+        }
+    }
+
+    reader.join();
+    for (int fd : fds) {
+        close(fd);
+    }
+    for (long long waited : waits) {
+        stats.workerWaitMicroseconds += waited;
+    }
+    return stats;
+}
+
+/**
+ * The function PrintPipelineStats prints the read backend, the throughput of the reads, how long each
+ * side of the ring waited for the other, and the work of every thread. Workers that wait a long time
+ * for filled buffers mean the reads cannot keep up; a reader that waits for buffers means the
+ * tokenizing cannot.
+ *
+ * @param stats What `PipelinedForEachWord` returned.
+ */
+inline void PrintPipelineStats(const PipelineStats& stats) {
+    if (!stats.fallbackReason.empty()) {
+        std::cout << stats.fallbackReason << ", using the pread pool.\n";
+    }
+    std::cout << "Read " << stats.bytes / 1e6 << " MB in " << stats.reads << " reads with " << stats.backend << "; threads waited "
+              << stats.workerWaitMicroseconds / 1000.0 << " milliseconds in total for filled buffers, the reader "
+              << stats.readerWaitMicroseconds / 1000.0 << " milliseconds for free ones.\n";
+    PrintThreadStats(stats.threads);
+}
+
+#endif
@@ -7,8 +7,8 @@
 #SBATCH --output=serial.%j.out
 #SBATCH --partition=defq
 
- g++ bloomfilters.cpp -o serial -lm;
+make bloomfilters
 
-./serial
+./bloomfilters
 
 exit 0
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+
+#include "bloomhash.h"
+#include "wordreader.h"
+
+#define REPEATS 10
+
+/* Totals produced by one tokenizer over one file, compared between tokenizers to check they agree. */
+struct TokenizeResult {
+    long long words = 0;
+    uint64_t checksum = 0;
+    long long microseconds = 0;
+};
+
+/**
+ * The function StreamTokenize is the loop the programs used before `wordreader.h`: `operator>>` into a
+ * `std::string` followed by a per-character `std::tolower`.
+ *
+ * @param filename The file to tokenize.
+ *
+ * @return the word count and the sum of the word hashes.
+ */
+TokenizeResult StreamTokenize(const std::string& filename) {
+    TokenizeResult result;
+    std::ifstream file(filename);
+    std::string word;
+
+    while (file >> word) {
+        for (char& c : word) {
+            c = std::tolower(c);
+        }
+        result.words++;
+        result.checksum += HashWord(word);
+    }
+    return result;
+}
+
+/**
+ * The function ScalarTokenize walks a byte range one byte at a time with `IsSpace`, which is the loop
+ * `ForEachWord` used before the whitespace mask.
+ *
+ * @param p Pointer to the first byte of the range.
+ * @param end Pointer one past the last byte of the range.
+ *
+ * @return the word count and the sum of the word hashes.
+ */
+TokenizeResult ScalarTokenize(const char* p, const char* end) {
+    TokenizeResult result;
+
+    while (p < end) {
+        while (p < end && IsSpace(*p)) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        const char* start = p;
+        while (p < end && !IsSpace(*p)) {
+            p++;
+        }
+        result.words++;
+        result.checksum += HashWord(std::string_view(start, p - start));
+    }
+    return result;
+}
+
+/**
+ * The function MaskTokenize runs `ForEachWord`, which classifies 64 bytes at a time with SIMD compares.
+ *
+ * @param file The mapped file to tokenize.
+ *
+ * @return the word count and the sum of the word hashes.
+ */
+TokenizeResult MaskTokenize(const MappedFile& file) {
+    TokenizeResult result;
+    result.words = ForEachWord(file.data(), file.data() + file.size(), [&](std::string_view word) {
+        result.checksum += HashWord(word);
+    });
+    return result;
+}
+
+/**
+ * The function CheckRangeEnds runs `ForEachWord` over ranges of every length up to 200 bytes that end
+ * in the middle of a word, including lengths that are a multiple of the 64-byte block, where the last
+ * word has no partial block after it to close it, and compares them with the byte scan.
+ *
+ * @return true if both see the same words in every range.
+ */
+bool CheckRangeEnds() {
+    std::string text;
+    for (int i = 0; text.size() < 256; ++i) {
+        text += "word" + std::to_string(i) + (i % 3 ? " " : "\n\t");
+    }
+
+    for (size_t length = 1; length <= 200; ++length) {
+        for (size_t start : {size_t(0), size_t(1), size_t(7)}) {
+            const char* begin = text.data() + start;
+            TokenizeResult scalar = ScalarTokenize(begin, begin + length);
+            TokenizeResult mask;
+            mask.words = ForEachWord(begin, begin + length, [&](std::string_view word) {
+                mask.checksum += HashWord(word);
+            });
+            if (scalar.words != mask.words || scalar.checksum != mask.checksum) {
+                std::cerr << "Tokenizers disagree on a range of " << length << " bytes at offset " << start << std::endl;
+                return false;
+            }
+        }
+    }
+
+    /* one word filling a whole block, and one running over two */
+    std::string block(128, 'x');
+    for (size_t length : {size_t(64), size_t(128)}) {
+        if (ForEachWord(block.data(), block.data() + length, [](std::string_view) {}) != 1) {
+            std::cerr << "Tokenizers disagree on a single word of " << length << " bytes" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The function TimeBest runs a tokenizer `REPEATS` times and keeps the fastest run, which is the one
+ * least disturbed by the rest of the machine.
+ *
+ * @param tokenize A callable returning a `TokenizeResult`.
+ *
+ * @return the result of the fastest run with its time filled in.
+ */
+template <typename Func>
+TokenizeResult TimeBest(Func&& tokenize) {
+    TokenizeResult best;
+    best.microseconds = -1;
+
+    for (int i = 0; i < REPEATS; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        TokenizeResult result = tokenize();
+        auto end = std::chrono::high_resolution_clock::now();
+        result.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (best.microseconds < 0 || result.microseconds < best.microseconds) {
+            best = result;
+        }
+    }
+    return best;
+}
+
+/**
+ * The function PrintResult prints one line of the benchmark table.
+ */
+void PrintResult(const std::string& name, const TokenizeResult& result, size_t bytes) {
+    double seconds = result.microseconds / 1e6;
+    std::cout << "  " << name << ": " << result.words << " words in " << result.microseconds / 1000.0
+              << " milliseconds (" << (seconds > 0 ? bytes / 1e6 / seconds : 0.0) << " MB/s).\n";
+}
+
+/**
+ * The main function compares the old stream tokenizer, the byte-at-a-time scan and the SIMD mask scan
+ * on the sample books and checks that all three see the same words, then checks `ForEachWord` on
+ * short ranges that end in the middle of a word.
+ *
+ * @return 0 if all tokenizers agree on every file and range, 1 otherwise.
+ */
+int main() {
+    const std::string filenames[] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt"};
+    int status = CheckRangeEnds() ? 0 : 1;
+
+#if defined(__AVX2__)
+    std::cout << "Whitespace mask: AVX2\n";
+#elif defined(__SSE2__)
+    std::cout << "Whitespace mask: SSE2\n";
+#else
+    std::cout << "Whitespace mask: scalar\n";
+#endif
+
+    for (const auto& filename : filenames) {
+        MappedFile file(filename);
+
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file" << std::endl;
+            exit(1);
+        }
+
+        TokenizeResult stream = TimeBest([&] { return StreamTokenize(filename); });
+        TokenizeResult scalar = TimeBest([&] { return ScalarTokenize(file.data(), file.data() + file.size()); });
+        TokenizeResult mask = TimeBest([&] { return MaskTokenize(file); });
+
+        std::cout << filename << " (" << file.size() << " bytes, best of " << REPEATS << "):\n";
+        PrintResult("ifstream >> word + tolower", stream, file.size());
+        PrintResult("scalar byte scan         ", scalar, file.size());
+        PrintResult("SIMD whitespace mask     ", mask, file.size());
+
+        if (stream.words != mask.words || stream.checksum != mask.checksum ||
+            scalar.words != mask.words || scalar.checksum != mask.checksum) {
+            std::cerr << "Tokenizers disagree on " << filename << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
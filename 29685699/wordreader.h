@@ -0,0 +1,336 @@
+#ifndef WORDREADER_H
+#define WORDREADER_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define STREAM_BUFFER_SIZE (1 << 20)
+/* the range `--stream-buffer` accepts; words longer than the buffer are cut */
+#define STREAM_MIN_BUFFER_SIZE 64
+#define STREAM_MAX_BUFFER_SIZE (1ull << 30)
+
+/**
+ * The function IsSpace checks for the same whitespace characters as `std::isspace` in the "C" locale,
+ * without the locale lookup.
+ *
+ * @param c The character to test.
+ *
+ * @return true for space, tab, newline, vertical tab, form feed and carriage return.
+ */
+inline bool IsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * The function LowerAscii converts an ASCII capital letter to lowercase and leaves every other byte
+ * alone, which is what `std::tolower` does in the "C" locale.
+ *
+ * @param c The character to convert.
+ *
+ * @return the lowercase character.
+ */
+inline char LowerAscii(char c) {
+    return static_cast<unsigned char>(c - 'A') < 26 ? c + ('a' - 'A') : c;
+}
+
+/**
+ * The function ToLower copies a word into `out` in lowercase. It is only needed where a word has to be
+ * stored or compared as a string; hashing folds case itself.
+ *
+ * @param word The word as it appears in the file.
+ * @param out The string to write into. Its capacity is reused between calls.
+ *
+ * @return a reference to `out`.
+ */
+inline std::string& ToLower(std::string_view word, std::string& out) {
+    out.resize(word.size());
+    for (size_t i = 0; i < word.size(); ++i) {
+        out[i] = LowerAscii(word[i]);
+    }
+    return out;
+}
+
+/**
+ * A read-only memory mapping of a whole file. Words are read straight out of the mapped pages, so no
+ * stream buffer or per-word string is involved. `advice` is passed to `madvise`; the default suits
+ * reading the file from front to back.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename, int advice = MADV_SEQUENTIAL) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            length = st.st_size;
+            if (length == 0) {
+                opened = true;
+            } else {
+                void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    madvise(addr, length, advice);
+                    bytes = static_cast<const char*>(addr);
+                    opened = true;
+                }
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (bytes != nullptr) {
+            munmap(const_cast<char*>(bytes), length);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return opened; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+/**
+ * The function WhitespaceMask64 classifies 64 bytes at once. AVX2 handles 32 bytes per compare when
+ * the compiler targets it (`-mavx2` or `-march=native`), SSE2 handles 16 otherwise on x86-64, and a
+ * scalar loop is used everywhere else.
+ *
+ * @param p Pointer to 64 readable bytes.
+ *
+ * @return a mask with bit i set when `p[i]` is whitespace according to `IsSpace`.
+ */
+inline uint64_t WhitespaceMask64(const char* p) {
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i controlRange = _mm256_set1_epi8('\r' - '\t');
+    uint64_t mask = 0;
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+        __m256i offset = _mm256_sub_epi8(v, tab);
+        __m256i isControl = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, controlRange), offset);
+        __m256i isSpace = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), isControl);
+        mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(isSpace))) << (32 * i);
+    }
+    return mask;
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i controlRange = _mm_set1_epi8('\r' - '\t');
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        __m128i offset = _mm_sub_epi8(v, tab);
+        __m128i isControl = _mm_cmpeq_epi8(_mm_min_epu8(offset, controlRange), offset);
+        __m128i isSpace = _mm_or_si128(_mm_cmpeq_epi8(v, space), isControl);
+        mask |= static_cast<uint64_t>(_mm_movemask_epi8(isSpace)) << (16 * i);
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; ++i) {
+        mask |= static_cast<uint64_t>(IsSpace(p[i])) << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * The function ForEachWord splits a byte range on whitespace and passes each word to a callback as a
+ * `std::string_view` into the range, without copying it. Words keep their original case. The range is
+ * classified 64 bytes at a time with `WhitespaceMask64` and word boundaries are found by scanning the
+ * mask bits, so the bytes inside a word are never looked at one by one.
+ *
+ * @param begin Pointer to the first byte of the range.
+ * @param end Pointer one past the last byte of the range.
+ * @param func A callable taking `std::string_view`, invoked once per word in order.
+ *
+ * @return the number of words found in the range.
+ */
+template <typename Func>
+long long ForEachWord(const char* begin, const char* end, Func&& func) {
+    long long wordCount = 0;
+    const char* wordStart = nullptr;
+
+    for (const char* block = begin; block < end; block += 64) {
+        uint64_t spaces;
+        if (end - block >= 64) {
+            spaces = WhitespaceMask64(block);
+        } else {
+            /* past the end of the range counts as whitespace, which closes the last word */
+            spaces = ~uint64_t(0);
+            for (int i = 0; i < end - block; ++i) {
+                spaces &= ~(static_cast<uint64_t>(!IsSpace(block[i])) << i);
+            }
+        }
+
+        int pos = 0;
+        while (true) {
+            if (wordStart == nullptr) {
+                uint64_t starts = ~spaces & (~uint64_t(0) << pos);
+                if (starts == 0) {
+                    break;
+                }
+                pos = __builtin_ctzll(starts);
+                wordStart = block + pos;
+            }
+
+            uint64_t ends = spaces & (~uint64_t(0) << pos);
+            if (ends == 0) {
+                break;
+            }
+            pos = __builtin_ctzll(ends);
+            func(std::string_view(wordStart, block + pos - wordStart));
+            wordCount++;
+            wordStart = nullptr;
+        }
+    }
+    /* a range whose length is a multiple of 64 ends without a partial block to close its last word */
+    if (wordStart != nullptr) {
+        func(std::string_view(wordStart, end - wordStart));
+        wordCount++;
+    }
+
+    return wordCount;
+}
+
+/**
+ * The function ForEachQueryWord walks a query file made of `word count` pairs and passes only the
+ * words to a callback, skipping the count that follows each one.
+ *
+ * @param begin Pointer to the first byte of the range.
+ * @param end Pointer one past the last byte of the range.
+ * @param func A callable taking `std::string_view`, invoked once per query word in order.
+ *
+ * @return the number of query words found in the range.
+ */
+template <typename Func>
+long long ForEachQueryWord(const char* begin, const char* end, Func&& func) {
+    long long queryCount = 0;
+    bool isWord = true;
+
+    ForEachWord(begin, end, [&](std::string_view token) {
+        if (isWord) {
+            func(token);
+            queryCount++;
+        }
+        isWord = !isWord;
+    });
+
+    return queryCount;
+}
+
+/**
+ * The function ForEachQueryPair walks a query file made of `word count` pairs and passes each word
+ * together with its count to a callback.
+ *
+ * @param begin Pointer to the first byte of the range.
+ * @param end Pointer one past the last byte of the range.
+ * @param func A callable taking `std::string_view` and `long long`, invoked once per pair in order.
+ *
+ * @return the number of query words found in the range.
+ */
+template <typename Func>
+long long ForEachQueryPair(const char* begin, const char* end, Func&& func) {
+    long long queryCount = 0;
+    std::string_view word;
+
+    ForEachWord(begin, end, [&](std::string_view token) {
+        if (word.empty()) {
+            word = token;
+            return;
+        }
+        long long count = 0;
+        for (char c : token) {
+            count = c >= '0' && c <= '9' ? count * 10 + (c - '0') : count;
+        }
+        func(word, count);
+        queryCount++;
+        word = std::string_view();
+    });
+
+    return queryCount;
+}
+
+/**
+ * The function ForEachStreamWord reads words from a file descriptor that cannot be mapped, such as
+ * stdin or a FIFO, through one fixed buffer, so memory stays the same however long the input is. Each
+ * read is tokenized up to its last whitespace and the unfinished word after it is moved to the front
+ * of the buffer to be completed by the next read. A word longer than the whole buffer is cut at the
+ * buffer size.
+ *
+ * @param fd The descriptor to read until end of file.
+ * @param bufferSize The size of the buffer in bytes.
+ * @param func A callable taking `std::string_view`, invoked once per word in order.
+ * @param progress A callable taking the bytes read and words found so far, invoked after every read.
+ *
+ * @return the number of words read, or -1 if a read failed (`errno` is left set).
+ */
+template <typename Func, typename Progress>
+long long ForEachStreamWord(int fd, size_t bufferSize, Func&& func, Progress&& progress) {
+    std::vector<char> buffer(bufferSize);
+    size_t carry = 0;
+    unsigned long long bytesRead = 0;
+    long long wordCount = 0;
+
+    while (true) {
+        ssize_t n = read(fd, buffer.data() + carry, bufferSize - carry);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        bytesRead += n;
+
+        size_t filled = carry + n;
+        size_t cut = filled;
+        while (cut > 0 && !IsSpace(buffer[cut - 1])) {
+            cut--;
+        }
+        if (cut == 0) {
+            if (filled < bufferSize) {
+                /* no whitespace yet, keep reading into the same buffer */
+                carry = filled;
+                continue;
+            }
+            cut = filled;
+        }
+
+        wordCount += ForEachWord(buffer.data(), buffer.data() + cut, func);
+        carry = filled - cut;
+        std::memmove(buffer.data(), buffer.data() + cut, carry);
+        progress(bytesRead, wordCount);
+    }
+
+    wordCount += ForEachWord(buffer.data(), buffer.data() + carry, func);
+    return wordCount;
+}
+
+#endif
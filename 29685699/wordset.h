@@ -0,0 +1,179 @@
+#ifndef WORDSET_H
+#define WORDSET_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "bloomhash.h"
+#include "wordreader.h"
+
+/**
+ * A set of words stored in lowercase, used as the exact set behind a Bloom filter. The words are
+ * appended one after the other to a single arena, and the table is an open-addressing array of slots
+ * with linear probing. Each slot keeps the `HashWord` value of its word next to the word's place in
+ * the arena, so a lookup compares 64-bit hashes while it probes and only reads the word itself when
+ * the hashes match. Because `HashWord` ignores case, words can be inserted and looked up as they
+ * appear in the file, and a caller that has already hashed a word for a filter can pass the hash in.
+ */
+class WordSet {
+public:
+    WordSet() : slots(MIN_CAPACITY) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    /**
+     * The function `reserve` sizes the table for at least `words` words, so that inserting them does
+     * not rehash. The arena grows as needed.
+     */
+    void reserve(size_t words) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity * MAX_LOAD_NUM < words * MAX_LOAD_DEN) {
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            Rehash(capacity);
+        }
+    }
+
+    /**
+     * The function `insert` adds a word in lowercase if it is not already in the set.
+     *
+     * @param word The word to add. Case is ignored. Must not be empty.
+     *
+     * @return true if the word was added, false if it was already there.
+     */
+    bool insert(std::string_view word) {
+        return insertHash(HashWord(word), word);
+    }
+
+    /**
+     * The function `insertHash` is `insert` for a word whose `HashWord` value is already known.
+     */
+    bool insertHash(uint64_t hash, std::string_view word) {
+        if ((count + 1) * MAX_LOAD_DEN > slots.size() * MAX_LOAD_NUM) {
+            Rehash(slots.size() * 2);
+        }
+
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.length == 0) {
+                slot.hash = hash;
+                slot.offset = static_cast<uint32_t>(arena.size());
+                slot.length = static_cast<uint32_t>(word.size());
+                for (char c : word) {
+                    arena.push_back(LowerAscii(c));
+                }
+                count++;
+                return true;
+            }
+            if (slot.hash == hash && Matches(slot, word)) {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * The function `contains` checks whether a word is in the set.
+     *
+     * @param word The word to look up. Case is ignored.
+     *
+     * @return true if the word is in the set.
+     */
+    bool contains(std::string_view word) const {
+        return containsHash(HashWord(word), word);
+    }
+
+    /**
+     * The function `containsHash` is `contains` for a word whose `HashWord` value is already known.
+     */
+    bool containsHash(uint64_t hash, std::string_view word) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (slot.length == 0) {
+                return false;
+            }
+            if (slot.hash == hash && Matches(slot, word)) {
+                return true;
+            }
+        }
+    }
+
+    /**
+     * The function `merge` adds every word of `other` to this set, reusing the stored hashes.
+     */
+    void merge(const WordSet& other) {
+        reserve(count + other.count);
+        other.ForEach([&](uint64_t hash, std::string_view word) {
+            insertHash(hash, word);
+        });
+    }
+
+    /**
+     * The function ForEach passes every word in the set, in lowercase, to a callback together with its
+     * hash. The order is unspecified.
+     *
+     * @param func A callable taking `uint64_t` and `std::string_view`.
+     */
+    template <typename Func>
+    void ForEach(Func&& func) const {
+        for (const Slot& slot : slots) {
+            if (slot.length != 0) {
+                func(slot.hash, std::string_view(arena.data() + slot.offset, slot.length));
+            }
+        }
+    }
+
+private:
+    static const size_t MIN_CAPACITY = 16;
+    /* the table is grown when it would become more than 3/4 full */
+    static const size_t MAX_LOAD_NUM = 3;
+    static const size_t MAX_LOAD_DEN = 4;
+
+    /* a word in the table; length 0 marks an empty slot, since words are never empty */
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    /* compares the lowercase word stored for `slot` with `word` in any case */
+    bool Matches(const Slot& slot, std::string_view word) const {
+        if (slot.length != word.size()) {
+            return false;
+        }
+        const char* stored = arena.data() + slot.offset;
+        for (size_t i = 0; i < word.size(); ++i) {
+            if (stored[i] != LowerAscii(word[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* moves every slot into a table of `capacity` slots; the arena is left as it is */
+    void Rehash(size_t capacity) {
+        std::vector<Slot> old(capacity);
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.length == 0) {
+                continue;
+            }
+            size_t i = slot.hash & mask;
+            while (slots[i].length != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots;
+    std::vector<char> arena;
+    size_t count = 0;
+};
+
+#endif
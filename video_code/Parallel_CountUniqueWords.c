@@ -2,93 +2,178 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <time.h>
-#include <omp.h>
 #include <pthread.h>
+#include "WordTable.h"
 
-#define MAX_WORD_LENGTH 100
 #define NUM_THREADS 3
-
-int isWordInList(char *word, char **wordList, int numWords) {
-    for (int i = 0; i < numWords; i++) {
-        if (strcmp(word, wordList[i]) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+#define FILE_COUNT 3
+#define CHUNK_SIZE (256 * 1024)
+
+// A whitespace-aligned byte range of one file, the unit of work handed to the threads
+typedef struct Chunk {
+    int file;
+    size_t begin;
+    size_t end;
+    // Words in the range, and how many of them to insert
+    long words;
+    long limit;
+} Chunk;
+
+char *filenames[FILE_COUNT] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
+int fileLengths[FILE_COUNT] = {215724, 195467, 965465};
+char **ppWordListArray[FILE_COUNT] = {0};
+int wordListLengthArray[FILE_COUNT] = {0};
+
+char *fileData[FILE_COUNT] = {0};
+WordTable tables[FILE_COUNT];
+Chunk *chunks = NULL;
+int chunkCount = 0;
+_Atomic int nextChunk;
+
+// The table and arena a word is inserted into, passed through ForEachWordIn
+typedef struct InsertContext {
+    WordTable *table;
+    WordArena *arena;
+} InsertContext;
+
+static void InsertWord(void *context, const char *word, size_t length, size_t offset) {
+    InsertContext *target = (InsertContext *)context;
+    WordTableInsert(target->table, target->arena, word, length, offset);
 }
 
-int ReadFromFileToArray(const char *filename, int fileLength, char ***ppArray) {
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return -1;
+// Function to split every file into chunks of about CHUNK_SIZE bytes that end at whitespace,
+// so no word is cut in two
+void MakeChunks(size_t sizes[]) {
+    int capacity = FILE_COUNT;
+    for (int f = 0; f < FILE_COUNT; f++) {
+        capacity += sizes[f] / CHUNK_SIZE + 1;
     }
-
-    char word[MAX_WORD_LENGTH];
-    char **FileWordList = (char **)malloc(fileLength * sizeof(char *));
-    char **UniqueWordList = (char **)malloc(fileLength * sizeof(char *));
-    int UniqueWordListLength = 0;
-
-    for (int i = 0; i < fileLength; i++) {
-        fscanf(file, "%s", word);
-        FileWordList[i] = strdup(word);
-
-        for (int j = 0; FileWordList[i][j]; j++) {
-            FileWordList[i][j] = tolower(FileWordList[i][j]);
+    chunks = (Chunk *)calloc(capacity, sizeof(Chunk));
+
+    for (int f = 0; f < FILE_COUNT; f++) {
+        size_t begin = 0;
+        while (begin < sizes[f]) {
+            size_t end = begin + CHUNK_SIZE < sizes[f] ? begin + CHUNK_SIZE : sizes[f];
+            while (end < sizes[f] && !isspace((unsigned char)fileData[f][end])) {
+                end++;
+            }
+            chunks[chunkCount].file = f;
+            chunks[chunkCount].begin = begin;
+            chunks[chunkCount].end = end;
+            chunks[chunkCount].limit = LONG_MAX;
+            chunkCount++;
+            begin = end;
         }
+    }
+}
 
-        if (!isWordInList(FileWordList[i], UniqueWordList, UniqueWordListLength)) {
-            #pragma omp critical
-            UniqueWordList[UniqueWordListLength] = strdup(FileWordList[i]);
-            UniqueWordListLength++;
-            UniqueWordList = realloc(UniqueWordList, UniqueWordListLength * sizeof(char *));
+// Function run by every thread: takes the next chunk of any file until none are left, adds up to
+// `limit` of its words to the file's table and records how many words it saw
+void *ThreadFunc(void *pArg) {
+    WordArena *arena = (WordArena *)pArg;
+    int c;
+
+    while ((c = atomic_fetch_add(&nextChunk, 1)) < chunkCount) {
+        Chunk *chunk = &chunks[c];
+        if (chunk->limit > 0) {
+            InsertContext context = {&tables[chunk->file], arena};
+            chunk->words = ForEachWordIn(fileData[chunk->file], chunk->begin, chunk->end, chunk->limit, InsertWord, &context);
         }
     }
+    return NULL;
+}
 
-    fclose(file);
-
-    for (int i = 0; i < fileLength; i++) {
-        free(FileWordList[i]);
+// Function to run ThreadFunc on every thread until all chunks are done
+void RunPass(pthread_t tid[], WordArena arenas[], int threads) {
+    atomic_store(&nextChunk, 0);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&tid[i], 0, ThreadFunc, &arenas[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
     }
-    free(FileWordList);
-
-    *ppArray = UniqueWordList;
-
-    return UniqueWordListLength;
 }
 
-char *filenames[3] = {"MOBY_DICK.txt", "LITTLE_WOMEN.txt", "SHAKESPEARE.txt"};
-int fileLengths[3] = {215724, 195467, 965465};
-char **ppWordListArray[3] = {0};
-int wordListLengthArray[3] = {0};
-
-void *ThreadFunc(void *pArg) {
-    int my_rank = *((int *)pArg);
-    printf("Thread %d\n", my_rank);
-    wordListLengthArray[my_rank] = ReadFromFileToArray(filenames[my_rank], fileLengths[my_rank], &ppWordListArray[my_rank]);
-    return NULL;
+// Callback that keeps the offset of the last word it is given
+static void RecordOffset(void *context, const char *word, size_t length, size_t offset) {
+    (void)word;
+    (void)length;
+    *(size_t *)context = offset;
 }
 
-int main() {
-    pthread_t tid[NUM_THREADS];
-    int threadNum[NUM_THREADS];
+// The files are cut into chunks that all threads share, so a large file is counted by every thread
+// rather than by one, and the words of each file go into one concurrent table. The sequential version
+// only reads the first fileLengths[f] words of each file. For a file that turns out to be longer, the
+// list keeps only the words whose first occurrence comes before the next word; if its table, sized for
+// fileLengths[f] words, filled up first, the file is counted again from an empty table with every chunk
+// limited to the words still within that count.
+// Run with the thread count as the only argument (default NUM_THREADS).
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : NUM_THREADS;
+    if (threads < 1) {
+        threads = 1;
+    }
+    pthread_t *tid = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    WordArena *arenas = (WordArena *)calloc(threads, sizeof(WordArena));
+    size_t sizes[FILE_COUNT];
     struct timespec start, end;
 
     clock_gettime(CLOCK_MONOTONIC, &start);
 
-    for (int i = 0; i < NUM_THREADS; i++) {
-        threadNum[i] = i;
-        pthread_create(&tid[i], 0, ThreadFunc, &threadNum[i]);
+    for (int f = 0; f < FILE_COUNT; f++) {
+        fileData[f] = LoadFile(filenames[f], &sizes[f]);
+        if (fileData[f] == NULL) {
+            perror("Error opening file");
+            return 1;
+        }
+        WordTableInit(&tables[f], fileLengths[f]);
+    }
+    MakeChunks(sizes);
+
+    RunPass(tid, arenas, threads);
+
+    // Find the offset of word fileLengths[f] (counting from 0) of every longer file, the first word
+    // the sequential version does not read
+    long seen[FILE_COUNT] = {0};
+    size_t before[FILE_COUNT] = {SIZE_MAX, SIZE_MAX, SIZE_MAX};
+    for (int c = 0; c < chunkCount; c++) {
+        int f = chunks[c].file;
+        if (seen[f] <= fileLengths[f] && fileLengths[f] < seen[f] + chunks[c].words) {
+            ForEachWordIn(fileData[f], chunks[c].begin, chunks[c].end, fileLengths[f] - seen[f] + 1, RecordOffset, &before[f]);
+        }
+        seen[f] += chunks[c].words;
     }
 
-    for (int i = 0; i < NUM_THREADS; i++) {
-        pthread_join(tid[i], NULL);
+    // Count a longer file again if its table filled up, giving every chunk the number of its words
+    // still within the limit; the chunks of the other files are done
+    int refill[FILE_COUNT] = {0};
+    int again = 0;
+    for (int f = 0; f < FILE_COUNT; f++) {
+        if (atomic_load(&tables[f].full)) {
+            memset(tables[f].slots, 0, (tables[f].mask + 1) * sizeof(*tables[f].slots));
+            atomic_store(&tables[f].count, 0);
+            atomic_store(&tables[f].full, 0);
+            refill[f] = again = 1;
+        }
+        seen[f] = 0;
+    }
+    for (int c = 0; c < chunkCount; c++) {
+        int f = chunks[c].file;
+        long left = fileLengths[f] - seen[f];
+        long words = chunks[c].words;
+        chunks[c].limit = !refill[f] || left < 0 ? 0 : (left < words ? left : words);
+        seen[f] += words;
+    }
+    if (again) {
+        RunPass(tid, arenas, threads);
     }
 
     int n = 0;
-    for (int i = 0; i < 3; i++) {
-        n += wordListLengthArray[i];
+    for (int f = 0; f < FILE_COUNT; f++) {
+        wordListLengthArray[f] = WordTableToList(&tables[f], before[f], &ppWordListArray[f]);
+        n += wordListLengthArray[f];
     }
 
     clock_gettime(CLOCK_MONOTONIC, &end);
@@ -96,7 +181,20 @@ int main() {
     // Compute time taken
     double time_taken = (end.tv_sec - start.tv_sec) * 1e9;
     time_taken = (time_taken + (end.tv_nsec - start.tv_nsec)) * 1e-9;
+    printf("Total unique words from read files: %d (%d threads)\n", n, threads);
     printf("Time taken: %f seconds\n", time_taken);
 
+    for (int f = 0; f < FILE_COUNT; f++) {
+        free(ppWordListArray[f]);
+        WordTableFree(&tables[f]);
+        free(fileData[f]);
+    }
+    for (int i = 0; i < threads; i++) {
+        ArenaFree(&arenas[i]);
+    }
+    free(chunks);
+    free(arenas);
+    free(tid);
+
     return 0;
 }
@@ -5,75 +5,44 @@
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
-#include <vector>
+#include "WordTable.h"
 // To run this file gcc -o seq Sequential_CountUniqueWords.c -lm
 
-// Define a macro for maximum word length
-#define MAX_WORD_LENGTH 100 
+// The table and arena a word is inserted into, passed through ForEachWordIn
+typedef struct InsertContext {
+    WordTable *table;
+    WordArena *arena;
+} InsertContext;
 
-// Function to check if a given word is already in a given list
-int isWordInList(char *word, char **wordList, int numWords) {
-    // Iterate through the list of words
-    for (int i = 0; i < numWords; i++) {
-        // Compare each word with the given word
-        if (strcmp(word, wordList[i]) == 0) {
-            return 1; // Word is already in list
-        }
-    }
-    return 0; // Word is not in list
+static void InsertWord(void *context, const char *word, size_t length, size_t offset) {
+    InsertContext *target = (InsertContext *)context;
+    WordTableInsert(target->table, target->arena, word, length, offset);
 }
 
-// Function to read words from a file into an array, and return the array of unique words
-int ReadFromFileToArray(const char *filename, int fileLength, char ***pppArray)
+// Function to read words from a file into an array, and return the array of unique words.
+// Each word is looked up in a hash table instead of being compared with every unique word so far,
+// and the unique words are stored in the arena, which the caller frees
+int ReadFromFileToArray(const char *filename, int fileLength, WordArena *arena, char ***pppArray)
 {
-    // Open the file for reading
-	FILE *file = fopen(filename, "r");
-	if (file == NULL) {
+    // Read the whole file into memory
+	size_t size = 0;
+	char *data = LoadFile(filename, &size);
+	if (data == NULL) {
 		perror("Error opening file");
 		return -1;
 	}
 
-	char word[MAX_WORD_LENGTH]; // Temporary variable to store individual words from file
-	char **FileWordList = NULL;
-	char **UniqueWordList = NULL;
-	int UniqueWordListLength = 0;
-	
-    // Allocate memory to store all words in the file
-	FileWordList = (char**)malloc(fileLength * sizeof(char *));
-	
-    // Read each word from the file and store it in FileWordList
-	for(int i = 0; i < fileLength; i++){
-		fscanf(file, "%s", word);
-		FileWordList[i] = strdup(word);
-	}
-    
-    // Allocate memory to store unique words
-	UniqueWordList = (char**)malloc(fileLength * sizeof(char *));
-	fclose(file);
-	
-    // Check for unique words
-	for(int i = 0; i < fileLength; i++){
-		// Convert each word to lowercase for case-insensitive comparison
-		for (int j = 0; FileWordList[i][j]; j++) {
-		    FileWordList[i][j] = tolower(FileWordList[i][j]);
-		}
-		// Check if the word is already in the list of unique words
-		if (!isWordInList(FileWordList[i], UniqueWordList, UniqueWordListLength)) {
-		    	UniqueWordList[UniqueWordListLength] = strdup(FileWordList[i]);
-		    	UniqueWordListLength++;
-		}
-	}
-	
-    // Resize the array of unique words to its actual size
-	UniqueWordList = realloc(UniqueWordList, UniqueWordListLength * sizeof(char *));
-	*pppArray = UniqueWordList;
+    // Add each of the first fileLength words, in lowercase, to a table with room for all of them
+	WordTable table;
+	WordTableInit(&table, fileLength);
+	InsertContext context = {&table, arena};
+	ForEachWordIn(data, 0, size, fileLength, InsertWord, &context);
+	free(data);
+
+    // List the unique words in the order they first appear
+	int UniqueWordListLength = WordTableToList(&table, SIZE_MAX, pppArray);
+	WordTableFree(&table);
 
-    // Free the memory allocated for the FileWordList
-	for (int i = 0; i < fileLength; i++) {
-		free(FileWordList[i]);
-	}
-	free(FileWordList);
-	
 	return UniqueWordListLength;
 }
 
@@ -85,8 +54,8 @@ int main() {
     // Array to store the list of unique words for each file
 	char** ppWordListArray[3] = {0};
 	int wordListLengthArray[3] = {0};
+	WordArena arena = {NULL};
 	int i;
-	char writeFile[32] = {0};
 	
 	struct timespec start, end;
 	double time_taken; 
@@ -97,7 +66,7 @@ int main() {
 	
     // Read each file and find unique words
 	for (i=0; i<3; i++){
-		wordListLengthArray[i] = ReadFromFileToArray(filenames[i], fileLengths[i], &ppWordListArray[i]);
+		wordListLengthArray[i] = ReadFromFileToArray(filenames[i], fileLengths[i], &arena, &ppWordListArray[i]);
 		n += wordListLengthArray[i];
 	}
   
@@ -107,13 +76,11 @@ int main() {
     time_taken = (time_taken + (end.tv_nsec - start.tv_nsec)) * 1e-9; 
 	printf("Total unique words from read files: %d. Process time(s): %lf\n", n, time_taken);
    
-	// Free allocated memory
+	// Free allocated memory; the words themselves live in the arena
 	for (i=0; i<3; i++){
-		for (int j = 0; j < wordListLengthArray[i]; j++) {
-			free(ppWordListArray[i][j]);
-		}
 		free(ppWordListArray[i]);	
 	}
+	ArenaFree(&arena);
 
     return 0;
 }
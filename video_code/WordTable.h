@@ -0,0 +1,219 @@
+#ifndef WORD_TABLE_H
+#define WORD_TABLE_H
+
+// Include necessary libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Define a macro for maximum word length, as read by fscanf("%99s")
+#define MAX_WORD_LENGTH 100
+// Size of one block of a word arena
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+// One unique word: its hash, the byte offset of its first occurrence and the lowercase text
+typedef struct WordEntry {
+    uint64_t hash;
+    _Atomic size_t first;
+    size_t length;
+    char text[];
+} WordEntry;
+
+// A block of an arena; blocks are chained so the arena can be freed in one go
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+// Storage for word entries. Each thread has its own, so allocating needs no lock
+typedef struct WordArena {
+    ArenaBlock *head;
+} WordArena;
+
+// An open addressing hash table of word entries. Slots are set once with a compare and swap,
+// so several threads can insert into the same table at the same time
+typedef struct WordTable {
+    _Atomic(WordEntry *) *slots;
+    size_t mask;
+    _Atomic int count;
+    // Set when a new word was turned away because the table was half full
+    _Atomic int full;
+} WordTable;
+
+// Function to allocate an entry for a word at the end of an arena
+static WordEntry *ArenaAllocEntry(WordArena *arena, const char *word, size_t length, uint64_t hash, size_t offset) {
+    // Entries are kept 8-byte aligned for their hash and offset
+    size_t size = (sizeof(WordEntry) + length + 1 + 7) & ~(size_t)7;
+    if (arena->head == NULL || arena->head->used + size > ARENA_BLOCK_SIZE) {
+        ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + ARENA_BLOCK_SIZE);
+        block->next = arena->head;
+        block->used = 0;
+        arena->head = block;
+    }
+
+    WordEntry *entry = (WordEntry *)(arena->head->data + arena->head->used);
+    arena->head->used += size;
+    entry->hash = hash;
+    atomic_init(&entry->first, offset);
+    entry->length = length;
+    memcpy(entry->text, word, length);
+    entry->text[length] = '\0';
+    return entry;
+}
+
+// Function to give back the last entry allocated from an arena, when another thread stored the word first
+static void ArenaUndoEntry(WordArena *arena, WordEntry *entry) {
+    arena->head->used = (size_t)((char *)entry - arena->head->data);
+}
+
+// Function to free every block of an arena
+static void ArenaFree(WordArena *arena) {
+    while (arena->head != NULL) {
+        ArenaBlock *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+// Function to create a table for at most maxWords unique words, kept at most half full so it never grows
+static void WordTableInit(WordTable *table, size_t maxWords) {
+    size_t capacity = 16;
+    while (capacity < 2 * maxWords + 2) {
+        capacity *= 2;
+    }
+    table->slots = calloc(capacity, sizeof(*table->slots));
+    table->mask = capacity - 1;
+    atomic_init(&table->count, 0);
+    atomic_init(&table->full, 0);
+}
+
+static void WordTableFree(WordTable *table) {
+    free(table->slots);
+    table->slots = NULL;
+}
+
+// FNV-1a hash of a word
+static uint64_t HashWord(const char *word, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)word[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Function to add a lowercase word found at byte offset `offset` to a table. If the word is already
+// there, only its first offset is updated, so the earliest occurrence wins whichever thread saw it first.
+// A new word is not added once the table is half full; `full` is set instead, so probing always ends
+static void WordTableInsert(WordTable *table, WordArena *arena, const char *word, size_t length, size_t offset) {
+    uint64_t hash = HashWord(word, length);
+    WordEntry *fresh = NULL;
+
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+        WordEntry *entry = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+        if (entry == NULL) {
+            if ((size_t)atomic_load_explicit(&table->count, memory_order_relaxed) >= (table->mask + 1) / 2) {
+                atomic_store_explicit(&table->full, 1, memory_order_relaxed);
+                if (fresh != NULL) {
+                    ArenaUndoEntry(arena, fresh);
+                }
+                return;
+            }
+            if (fresh == NULL) {
+                fresh = ArenaAllocEntry(arena, word, length, hash, offset);
+            }
+            if (atomic_compare_exchange_strong_explicit(&table->slots[i], &entry, fresh, memory_order_acq_rel, memory_order_acquire)) {
+                atomic_fetch_add_explicit(&table->count, 1, memory_order_relaxed);
+                return;
+            }
+            // Another thread took the slot first; entry is now its word
+        }
+        if (entry->hash == hash && entry->length == length && memcmp(entry->text, word, length) == 0) {
+            size_t first = atomic_load_explicit(&entry->first, memory_order_relaxed);
+            while (offset < first && !atomic_compare_exchange_weak_explicit(&entry->first, &first, offset, memory_order_relaxed, memory_order_relaxed)) {
+            }
+            if (fresh != NULL) {
+                ArenaUndoEntry(arena, fresh);
+            }
+            return;
+        }
+    }
+}
+
+static int CompareFirstOccurrence(const void *a, const void *b) {
+    size_t x = atomic_load_explicit(&(*(WordEntry *const *)a)->first, memory_order_relaxed);
+    size_t y = atomic_load_explicit(&(*(WordEntry *const *)b)->first, memory_order_relaxed);
+    return (x > y) - (x < y);
+}
+
+// Function to return the unique words of a table that first occur before byte offset `before`, in order
+// of first occurrence, the order the linear scan used to produce. The strings belong to the arenas, so
+// only the returned array is freed by the caller
+static int WordTableToList(const WordTable *table, size_t before, char ***pppArray) {
+    int count = atomic_load(&table->count);
+    WordEntry **entries = (WordEntry **)malloc((count > 0 ? count : 1) * sizeof(WordEntry *));
+    int n = 0;
+    for (size_t i = 0; i <= table->mask; i++) {
+        WordEntry *entry = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+        if (entry != NULL && atomic_load_explicit(&entry->first, memory_order_relaxed) < before) {
+            entries[n++] = entry;
+        }
+    }
+    qsort(entries, n, sizeof(WordEntry *), CompareFirstOccurrence);
+
+    char **list = (char **)malloc((n > 0 ? n : 1) * sizeof(char *));
+    for (int i = 0; i < n; i++) {
+        list[i] = entries[i]->text;
+    }
+    free(entries);
+    *pppArray = list;
+    return n;
+}
+
+// Function to read a whole file into memory; returns NULL if it cannot be opened
+static char *LoadFile(const char *filename, size_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *data = (char *)malloc(length > 0 ? length : 1);
+    *size = fread(data, 1, length > 0 ? length : 0, file);
+    fclose(file);
+    return data;
+}
+
+// Function to walk the words of data[begin, end) as fscanf("%99s") would read them: whitespace
+// separated, with longer tokens split into pieces of 99 characters. Every word, lowercased, is passed
+// to func with its byte offset until limit words have been seen; returns the number of words seen
+static long ForEachWordIn(const char *data, size_t begin, size_t end, long limit, void (*func)(void *context, const char *word, size_t length, size_t offset), void *context) {
+    char word[MAX_WORD_LENGTH];
+    long words = 0;
+    size_t i = begin;
+
+    while (i < end && words < limit) {
+        if (isspace((unsigned char)data[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        size_t length = 0;
+        while (i < end && length < MAX_WORD_LENGTH - 1 && !isspace((unsigned char)data[i])) {
+            word[length++] = (char)tolower((unsigned char)data[i]);
+            i++;
+        }
+        words++;
+        if (func != NULL) {
+            func(context, word, length, start);
+        }
+    }
+    return words;
+}
+
+#endif